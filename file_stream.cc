@@ -1,5 +1,9 @@
 #include "file_stream.h"
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -15,3 +19,44 @@ auto FileStream::loadBytes(size_t offset, size_t size) -> unique_ptr<char[]> {
   }
   return uni;
 }
+
+MappedFileStream::MappedFileStream(const char *path, Access access) {
+  struct stat status;
+  auto fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return;
+
+  if (fstat(fd, &status) == 0) {
+    size_ = status.st_size;
+    auto data = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0)
+                          : nullptr;
+    opened_ = data != MAP_FAILED;
+    data_ = opened_ ? static_cast<const char *>(data) : nullptr;
+    size_ = opened_ ? size_ : 0;
+  }
+  close(fd);
+  advise(access);
+}
+
+MappedFileStream::~MappedFileStream() {
+  if (data_ != nullptr)
+    munmap(const_cast<char *>(data_), size_);
+}
+
+void MappedFileStream::advise(Access access) {
+  static constexpr int Advice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM};
+  if (data_ != nullptr)
+    madvise(const_cast<char *>(data_), size_, Advice[access]);
+}
+
+void MappedFileStream::willNeed(size_t offset, size_t size) {
+  static const size_t Page = sysconf(_SC_PAGESIZE);
+  auto bytes = viewBytes(offset, size);
+  if (bytes.empty())
+    return;
+
+  // madvise wants a page aligned start
+  auto begin = (offset / Page) * Page;
+  madvise(const_cast<char *>(data_) + begin, offset - begin + bytes.size(),
+          MADV_WILLNEED);
+}
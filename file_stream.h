@@ -1,8 +1,13 @@
 #ifndef __FILE_STREAM_H__
 #define __FILE_STREAM_H__
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <memory>
+#include <span>
+#include <string_view>
 
 using namespace std;
 
@@ -12,6 +17,17 @@ public:
              ios_base::openmode mode = ios_base::binary | ios_base::in)
       : fstream(path, mode) {}
 
+  bool isOpen() const { return is_open(); }
+
+  // bytes in the file, the get position is left where it was
+  size_t fileSize() {
+    auto here = tellg();
+    seekg(0, ios::end);
+    auto end = tellg();
+    seekg(here);
+    return end < 0 ? 0 : static_cast<size_t>(end);
+  }
+
   template <class Block>
   auto loadBlock(Block &block, size_t offset = 0, size_t index = 0) {
     seekg(offset + sizeof(block) * index, ios::beg);
@@ -26,6 +42,71 @@ public:
     return gcount();
   }
 
+  // append at the put position, false if the stream failed
+  template <class Block> bool storeBlocks(const Block *block, size_t num) {
+    write(reinterpret_cast<const char *>(block), num * sizeof(*block));
+    return !fail();
+  }
+
   auto loadBytes(size_t offset, size_t size) -> unique_ptr<char[]>;
 };
+
+/*
+ * Read-only mapping of a whole file. The load*() calls copy like those
+ * of FileStream, so either fits code templated on the stream; view*()
+ * hand out spans right into the mapping instead, no copy, no seek and
+ * no allocation, valid as long as the stream lives.
+ *
+ * The access pattern is passed on to the kernel through madvise():
+ * Sequential reads ahead aggressively and drops pages behind, Random
+ * reads no more than asked.
+ */
+class MappedFileStream {
+public:
+  enum Access { Normal, Sequential, Random };
+
+  MappedFileStream(const char *path, Access access = Sequential);
+  MappedFileStream(const MappedFileStream &) = delete;
+  MappedFileStream &operator=(const MappedFileStream &) = delete;
+  ~MappedFileStream();
+
+  bool isOpen() const { return opened_; }
+  size_t fileSize() const { return size_; }
+
+  void advise(Access access);
+  // start reading [offset, offset + size) in, ahead of the views on it
+  void willNeed(size_t offset, size_t size);
+
+  // up to `num` whole blocks at `offset`, empty if misaligned
+  template <class Block>
+  span<const Block> viewBlocks(size_t offset, size_t num) const {
+    if (offset > size_ ||
+        reinterpret_cast<uintptr_t>(data_ + offset) % alignof(Block) != 0)
+      return {};
+    num = min(num, (size_ - offset) / sizeof(Block));
+    return {reinterpret_cast<const Block *>(data_ + offset), num};
+  }
+
+  string_view viewBytes(size_t offset, size_t size) const {
+    offset = min(offset, size_);
+    return {data_ + offset, min(size, size_ - offset)};
+  }
+
+  template <class Block>
+  auto loadBlock(Block &block, size_t offset = 0, size_t index = 0) {
+    return loadBlocks(&block, offset + sizeof(block) * index, 1);
+  }
+
+  template <class Block>
+  auto loadBlocks(Block *block, size_t offset, size_t num) {
+    auto bytes = viewBytes(offset, num * sizeof(*block));
+    bytes.copy(reinterpret_cast<char *>(block), bytes.size());
+    return static_cast<streamsize>(bytes.size());
+  }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool opened_ = false;
+};
 #endif
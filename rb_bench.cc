@@ -0,0 +1,213 @@
+#include "rb_bench.h"
+#include "rb_finger_tree.h"
+#include "rb_map.h"
+#include "rb_tree.h"
+
+using namespace std;
+
+#ifdef _BENCH_ENABLE
+
+#include "testcase.h"
+#include <map>
+#include <set>
+
+namespace {
+struct Entry {
+  i64 key;
+  i64 value;
+};
+
+struct EntryKey {
+  i64 operator()(const Entry &entry) const { return entry.key; }
+};
+
+constexpr char TreeName[] = "rb_tree";
+constexpr char FingerTreeName[] = "rb_finger_tree";
+
+/*
+ * The structures under test behind one interface. The intrusive trees
+ * get their nodes up front, one per key, and unlink them without a
+ * search, which is how intrusive containers are used.
+ */
+template <class Tree, const char *Label> class IntrusiveSubject {
+public:
+  static constexpr const char *Name = Label;
+
+  explicit IntrusiveSubject(size_t n) : nodes_(2 * n), n_{n} {}
+
+  void insert(i64 key) {
+    auto &node = nodeOf(key);
+    node.key = node.value = key;
+    tree_.insertNode(&node);
+  }
+  void erase(i64 key) { tree_.deleteNode(&nodeOf(key)); }
+  bool find(i64 key) { return tree_.search(key) != nullptr; }
+
+  i64 scan(i64 key, size_t count) {
+    i64 sum = 0;
+    for (auto node = tree_.lowerBound(key); node != nullptr && count-- > 0;
+         node = node->getNodeNext()) {
+      sum += node->value;
+    }
+    return sum;
+  }
+
+private:
+  // even keys first, then the odd ones
+  RbNode<Entry> &nodeOf(i64 key) {
+    return nodes_[key % 2 == 0 ? key / 2 : n_ + key / 2];
+  }
+
+  vector<RbNode<Entry>> nodes_;
+  size_t n_;
+  Tree tree_;
+};
+
+using TreeSubject =
+    IntrusiveSubject<RbTree<Entry, i64, less<>, EntryKey>, TreeName>;
+// the same nodes, inserts starting from the fingers rather than the root
+using FingerSubject =
+    IntrusiveSubject<RbFingerTree<Entry, i64, less<>, EntryKey>,
+                     FingerTreeName>;
+
+class RbMapSubject {
+public:
+  static constexpr const char *Name = "rb_map";
+
+  explicit RbMapSubject(size_t) {}
+
+  void insert(i64 key) { map_.tryEmplace(key, key); }
+  void erase(i64 key) { map_.erase(key); }
+  bool find(i64 key) { return map_.contains(key); }
+
+  i64 scan(i64 key, size_t count) {
+    i64 sum = 0;
+    for (auto it = map_.lowerBound(key); it != map_.end() && count-- > 0;
+         ++it) {
+      sum += it->second;
+    }
+    return sum;
+  }
+
+private:
+  RbMap<i64, i64> map_;
+};
+
+class StdMapSubject {
+public:
+  static constexpr const char *Name = "std_map";
+
+  explicit StdMapSubject(size_t) {}
+
+  void insert(i64 key) { map_.emplace(key, key); }
+  void erase(i64 key) { map_.erase(key); }
+  bool find(i64 key) { return map_.contains(key); }
+
+  i64 scan(i64 key, size_t count) {
+    i64 sum = 0;
+    for (auto it = map_.lower_bound(key); it != map_.end() && count-- > 0;
+         ++it) {
+      sum += it->second;
+    }
+    return sum;
+  }
+
+private:
+  map<i64, i64> map_;
+};
+
+class StdSetSubject {
+public:
+  static constexpr const char *Name = "std_set";
+
+  explicit StdSetSubject(size_t) {}
+
+  void insert(i64 key) { set_.insert(key); }
+  void erase(i64 key) { set_.erase(key); }
+  bool find(i64 key) { return set_.contains(key); }
+
+  i64 scan(i64 key, size_t count) {
+    i64 sum = 0;
+    for (auto it = set_.lower_bound(key); it != set_.end() && count-- > 0;
+         ++it) {
+      sum += *it;
+    }
+    return sum;
+  }
+
+private:
+  set<i64> set_;
+};
+
+// results must look used, or lookups get optimized away
+volatile i64 benchSink;
+
+class BenchRbTree : public TestcaseBase {
+public:
+  static constexpr size_t ScanLength = 100;
+
+  virtual void testRoutine() override {
+    RbBenchReport report;
+    RbPerfCounters counters;
+
+    for (auto n : RbBenchConfig::get().sizes()) {
+      for (int d = RbBenchKeys::Uniform; d <= RbBenchKeys::Adversarial; d++) {
+        auto distribution = static_cast<RbBenchKeys::Distribution>(d);
+        run<TreeSubject>(report, counters, distribution, n);
+        run<FingerSubject>(report, counters, distribution, n);
+        run<RbMapSubject>(report, counters, distribution, n);
+        run<StdMapSubject>(report, counters, distribution, n);
+        run<StdSetSubject>(report, counters, distribution, n);
+      }
+    }
+  }
+
+  /*
+   * insert the n keys, look n up, scan from n / ScanLength of them, run
+   * n mixed operations, half lookups and half toggling an odd key in or
+   * out, then delete the n keys again
+   */
+  template <class Subject>
+  void run(RbBenchReport &report, RbPerfCounters &counters,
+           RbBenchKeys::Distribution distribution, size_t n) {
+    auto seed = RbBenchConfig::get().seed;
+    auto order = RbBenchKeys::insertOrder(distribution, n, seed);
+    auto accesses = RbBenchKeys::accesses(distribution, n, n, seed + 1);
+    Subject subject{n};
+    i64 sink = 0;
+
+    auto add = [&](const char *workload, RbBenchResult result) {
+      result.structure = Subject::Name;
+      result.workload = workload;
+      result.distribution = RbBenchKeys::Names[distribution];
+      result.size = n;
+      report.add(result);
+    };
+
+    add("insert", rbMeasure(counters, n,
+                            [&](size_t i) { subject.insert(order[i]); }));
+    add("lookup", rbMeasure(counters, n, [&](size_t i) {
+          sink += subject.find(accesses[i]);
+        }));
+    add("scan", rbMeasure(counters, max<size_t>(1, n / ScanLength),
+                          [&](size_t i) {
+                            sink += subject.scan(accesses[i], ScanLength);
+                          }));
+    add("mixed", rbMeasure(counters, n, [&](size_t i) {
+          auto key = accesses[i] | 1;
+          if (i % 2 == 0) {
+            sink += subject.find(accesses[i]);
+          } else if (subject.find(key)) {
+            subject.erase(key);
+          } else {
+            subject.insert(key);
+          }
+        }));
+    add("delete", rbMeasure(counters, n,
+                            [&](size_t i) { subject.erase(order[i]); }));
+    benchSink = sink;
+  }
+};
+} // namespace
+INIT_CASE(BenchRbTree)
+#endif
@@ -0,0 +1,360 @@
+#ifndef __RB_BENCH_H__
+#define __RB_BENCH_H__
+
+#include "types.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <numeric>
+#include <random>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Benchmark helpers, shared by the cases of the bench target: seeded key
+ * streams, hardware counters and the CSV/JSON report. Runs are set up
+ * through the environment, as the cases take no arguments:
+ *   RB_BENCH_MAX     largest size, 1K up in steps of 10 (default 1M)
+ *   RB_BENCH_SEED    generator seed (default 20240621)
+ *   RB_BENCH_FORMAT  csv (default) or json
+ */
+struct RbBenchConfig {
+  size_t maxSize = 1000000;
+  u64 seed = 20240621;
+  bool json = false;
+
+  static const RbBenchConfig &get() {
+    static const RbBenchConfig config = [] {
+      RbBenchConfig config;
+      if (auto max = getenv("RB_BENCH_MAX"))
+        config.maxSize = strtoull(max, nullptr, 10);
+      if (auto seed = getenv("RB_BENCH_SEED"))
+        config.seed = strtoull(seed, nullptr, 10);
+      if (auto format = getenv("RB_BENCH_FORMAT"))
+        config.json = strcmp(format, "json") == 0;
+      return config;
+    }();
+    return config;
+  }
+
+  vector<size_t> sizes() const {
+    vector<size_t> sizes;
+    for (size_t size = 1000; size <= maxSize; size *= 10) {
+      sizes.push_back(size);
+    }
+    return sizes;
+  }
+};
+
+/*
+ * Key streams over the n keys 0, 2, .., 2(n - 1), odd keys being sure
+ * misses. insertOrder() is a permutation of them, accesses() a stream
+ * drawn from them:
+ *   Uniform      random permutation / uniform draws
+ *   Sequential   ascending / round robin
+ *   Zipfian      random permutation / draws skewed by Zipf's law, 0.99,
+ *                hot keys scattered over the key space
+ *   Adversarial  both ends in turn, 0, max, 1, max - 1.. / uniform
+ *                misses, every lookup goes down to a leaf and fails
+ */
+class RbBenchKeys {
+public:
+  enum Distribution { Uniform, Sequential, Zipfian, Adversarial };
+
+  static constexpr const char *Names[] = {"uniform", "sequential", "zipfian",
+                                          "adversarial"};
+
+  static vector<i64> insertOrder(Distribution distribution, size_t n,
+                                 u64 seed) {
+    vector<i64> keys(n);
+    iota(keys.begin(), keys.end(), 0);
+
+    if (distribution == Adversarial) {
+      for (size_t i = 0; i < n; i++) {
+        keys[i] = i % 2 == 0 ? i / 2 : n - 1 - i / 2;
+      }
+    } else if (distribution != Sequential) {
+      shuffle(keys.begin(), keys.end(), mt19937_64{seed});
+    }
+    for (auto &key : keys) {
+      key *= 2;
+    }
+    return keys;
+  }
+
+  static vector<i64> accesses(Distribution distribution, size_t n, size_t m,
+                              u64 seed) {
+    mt19937_64 rng{seed};
+    vector<i64> keys(m);
+
+    if (distribution == Zipfian) {
+      Zipf zipf{n};
+      for (auto &key : keys) {
+        key = 2 * (scramble(zipf(rng)) % n);
+      }
+      return keys;
+    }
+    for (size_t i = 0; i < m; i++) {
+      switch (distribution) {
+      case Sequential:
+        keys[i] = 2 * (i % n);
+        break;
+      case Adversarial:
+        keys[i] = 2 * (rng() % n) + 1;
+        break;
+      default:
+        keys[i] = 2 * (rng() % n);
+      }
+    }
+    return keys;
+  }
+
+private:
+  // ranks 0..n-1, rank 0 the hottest; Gray et al., "Quickly generating
+  // billion-record synthetic databases"
+  class Zipf {
+  public:
+    static constexpr double Theta = 0.99;
+
+    explicit Zipf(size_t n) : n_{n} {
+      for (size_t i = 1; i <= n; i++) {
+        zetaN_ += 1 / pow(i, Theta);
+      }
+      auto zeta2 = 1 + 1 / pow(2, Theta);
+      alpha_ = 1 / (1 - Theta);
+      eta_ = (1 - pow(2.0 / n, 1 - Theta)) / (1 - zeta2 / zetaN_);
+    }
+
+    size_t operator()(mt19937_64 &rng) {
+      auto u = uniform_real_distribution<double>{}(rng);
+      auto uz = u * zetaN_;
+      if (uz < 1)
+        return 0;
+      if (uz < 1 + pow(0.5, Theta))
+        return 1;
+      return min<size_t>(n_ - 1, n_ * pow(eta_ * u - eta_ + 1, alpha_));
+    }
+
+  private:
+    size_t n_;
+    double zetaN_ = 0, alpha_, eta_;
+  };
+
+  // so the hot ranks are not the smallest keys
+  static u64 scramble(u64 rank) {
+    rank ^= rank >> 33;
+    rank *= 0xff51afd7ed558ccd;
+    return rank ^ rank >> 33;
+  }
+};
+
+/*
+ * Cycles, instructions, cache and branch misses of this thread through
+ * perf_event_open, user space only. Counters the kernel refuses, as in
+ * most containers, read -1.
+ */
+class RbPerfCounters {
+public:
+  enum Event { Cycles, Instructions, CacheMisses, BranchMisses, Events };
+
+  static constexpr const char *Names[] = {"cycles", "instructions",
+                                          "cache_misses", "branch_misses"};
+
+  RbPerfCounters() {
+    static constexpr u64 Configs[] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+    for (int i = 0; i < Events; i++) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = Configs[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fds_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+  }
+  RbPerfCounters(const RbPerfCounters &) = delete;
+  RbPerfCounters &operator=(const RbPerfCounters &) = delete;
+  ~RbPerfCounters() {
+    for (auto fd : fds_) {
+      if (fd >= 0)
+        close(fd);
+    }
+  }
+
+  void start() {
+    for (auto fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void stop() {
+    for (int i = 0; i < Events; i++) {
+      counts_[i] = -1;
+      if (fds_[i] >= 0) {
+        ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds_[i], &counts_[i], sizeof(counts_[i])) !=
+            sizeof(counts_[i]))
+          counts_[i] = -1;
+      }
+    }
+  }
+
+  // over the last start() to stop()
+  i64 count(Event event) const { return counts_[event]; }
+
+private:
+  int fds_[Events];
+  i64 counts_[Events] = {-1, -1, -1, -1};
+};
+
+struct RbBenchResult {
+  string structure;
+  string workload;
+  string distribution;
+  size_t size;
+  size_t ops;
+  double nsPerOp;
+  double p50;
+  double p99;
+  i64 counters[RbPerfCounters::Events];
+};
+
+/*
+ * Time `ops` calls of op(i). ns_per_op covers them all, while p50 and p99
+ * are of single calls: one in about SampleEvery, at random gaps so as not
+ * to beat with a periodic workload, is timed on its own, the cost of the
+ * two clock reads taken off. A slow call thus shows in full in the tail,
+ * instead of averaged away over a batch of fast ones.
+ */
+template <class F>
+RbBenchResult rbMeasure(RbPerfCounters &counters, size_t ops, F &&op) {
+  using Clock = chrono::steady_clock;
+  constexpr size_t SampleEvery = 8;
+  auto elapsed = [](Clock::time_point from, Clock::time_point to) {
+    return chrono::duration<double, nano>(to - from).count();
+  };
+
+  // what a pair of back to back clock reads takes, the median of a few
+  vector<double> reads(63);
+  for (auto &read : reads) {
+    auto begin = Clock::now();
+    read = elapsed(begin, Clock::now());
+  }
+  nth_element(reads.begin(), reads.begin() + reads.size() / 2, reads.end());
+  auto overhead = reads[reads.size() / 2];
+
+  vector<double> samples;
+  samples.reserve(ops / SampleEvery + 1);
+  minstd_rand gaps{RbBenchConfig::get().seed};
+
+  counters.start();
+  auto start = Clock::now();
+  for (size_t i = 0, next = gaps() % SampleEvery; i < ops; i++) {
+    if (i != next) {
+      op(i);
+      continue;
+    }
+    auto begin = Clock::now();
+    op(i);
+    samples.push_back(max(0.0, elapsed(begin, Clock::now()) - overhead));
+    next += 1 + gaps() % (2 * SampleEvery - 1);
+  }
+  auto total = elapsed(start, Clock::now()) - samples.size() * overhead;
+  counters.stop();
+
+  RbBenchResult result{};
+  result.ops = ops;
+  result.nsPerOp = ops > 0 ? max(0.0, total) / ops : 0;
+  if (!samples.empty()) {
+    auto at = [&](double quantile) {
+      auto k = min(samples.size() - 1,
+                   static_cast<size_t>(quantile * samples.size()));
+      nth_element(samples.begin(), samples.begin() + k, samples.end());
+      return samples[k];
+    };
+    result.p50 = at(0.5);
+    result.p99 = at(0.99);
+  }
+  for (int i = 0; i < RbPerfCounters::Events; i++) {
+    result.counters[i] =
+        counters.count(static_cast<RbPerfCounters::Event>(i));
+  }
+  return result;
+}
+
+// rows to stdout as they come, the format fixed by RbBenchConfig
+class RbBenchReport {
+public:
+  RbBenchReport() : json_{RbBenchConfig::get().json} {
+    if (json_) {
+      printf("[\n");
+      return;
+    }
+    printf("structure,workload,distribution,size,ops,ns_per_op,p50_ns,p99_ns");
+    for (auto name : RbPerfCounters::Names) {
+      printf(",%s", name);
+    }
+    printf("\n");
+  }
+  RbBenchReport(const RbBenchReport &) = delete;
+  RbBenchReport &operator=(const RbBenchReport &) = delete;
+  ~RbBenchReport() {
+    if (json_)
+      printf("\n]\n");
+    fflush(stdout);
+  }
+
+  void add(const RbBenchResult &r) {
+    if (json_) {
+      printf("%s  {\"structure\": \"%s\", \"workload\": \"%s\", "
+             "\"distribution\": \"%s\", \"size\": %zu, \"ops\": %zu, "
+             "\"ns_per_op\": %.2f, \"p50_ns\": %.2f, \"p99_ns\": %.2f",
+             rows_++ > 0 ? ",\n" : "", r.structure.c_str(),
+             r.workload.c_str(), r.distribution.c_str(), r.size, r.ops,
+             r.nsPerOp, r.p50, r.p99);
+      for (int i = 0; i < RbPerfCounters::Events; i++) {
+        if (r.counters[i] < 0) {
+          printf(", \"%s\": null", RbPerfCounters::Names[i]);
+        } else {
+          printf(", \"%s\": %lld", RbPerfCounters::Names[i],
+                 static_cast<long long>(r.counters[i]));
+        }
+      }
+      printf("}");
+    } else {
+      printf("%s,%s,%s,%zu,%zu,%.2f,%.2f,%.2f", r.structure.c_str(),
+             r.workload.c_str(), r.distribution.c_str(), r.size, r.ops,
+             r.nsPerOp, r.p50, r.p99);
+      for (auto count : r.counters) {
+        if (count < 0) {
+          printf(",");
+        } else {
+          printf(",%lld", static_cast<long long>(count));
+        }
+      }
+      printf("\n");
+    }
+    fflush(stdout);
+  }
+
+private:
+  bool json_;
+  size_t rows_ = 0;
+};
+#endif
@@ -0,0 +1,160 @@
+#include "rb_concurrent_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Entry {
+  int get() const { return key; }
+
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+};
+
+/*
+ * Even keys are inserted before the readers start and stay, odd ones come
+ * and go, their entries reused once disposed of. Readers must always find
+ * every even key, and only ever see odd entries holding the key searched.
+ */
+class TestcaseRbConcurrentTree : public TestcaseBase {
+public:
+  static constexpr int Stable = 500;
+  static constexpr int Churn = 500;
+
+  enum State { Free, Linked, Retired };
+
+  struct Workload {
+    vector<Entry> nodes = vector<Entry>(Stable + Churn);
+    vector<State> states = vector<State>(Churn, Free);
+    RbConcurrentTree<Entry, int> tree{[this](Entry *node) {
+      states[node - nodes.data() - Stable] = Free;
+    }};
+    atomic<bool> stop{false};
+    atomic<bool> failed{false};
+    atomic<size_t> reads{0};
+
+    Workload() {
+      for (int i = 0; i < Stable; i++) {
+        nodes[i].key = 2 * i;
+        tree.insert(&nodes[i]);
+      }
+    }
+
+    /*
+     * writer: toggle random odd nodes in and out, `ops` times or until
+     * stopped, then yielding between writes so readers also get the cores
+     * when there are fewer cores than threads
+     */
+    void write(size_t ops, unsigned seed) {
+      mt19937 rng(seed);
+      for (size_t op = 0; op < ops || (ops == 0 && !stop); op++) {
+        if (ops == 0)
+          this_thread::yield();
+
+        auto i = rng() % Churn;
+        auto node = &nodes[Stable + i];
+        if (states[i] == Linked) {
+          states[i] = Retired;
+          tree.erase(node);
+        } else if (states[i] == Free) {
+          node->key = 2 * (rng() % Stable) + 1;
+          states[i] = Linked;
+          tree.insert(node);
+        }
+      }
+    }
+
+    void read(unsigned seed, bool walk) {
+      RbEpoch::Reader reader{tree.epoch()};
+      mt19937 rng(seed);
+      size_t done = 0;
+
+      while (!stop) {
+        auto guard = reader.pin();
+        int key = rng() % (2 * Stable);
+        auto value = tree.search(guard, key);
+        if ((key % 2 == 0 && value == nullptr) ||
+            (value != nullptr && value->key != key))
+          failed = true;
+
+        if (walk && done % 256 == 0) {
+          auto previous = -1, even = 0;
+          tree.forEachInorder(guard, [&](Entry *node) {
+            failed = failed || node->key < previous;
+            even += node->key % 2 == 0;
+            previous = node->key;
+          });
+          failed = failed || even != Stable;
+        }
+        done++;
+      }
+      reads += done;
+    }
+  };
+
+  virtual void testRoutine() override {
+    verifyReaders();
+    scaleReaders();
+  }
+
+  void verifyReaders() {
+    Workload workload;
+    vector<thread> readers;
+
+    for (unsigned i = 0; i < max(2u, thread::hardware_concurrency()); i++) {
+      readers.emplace_back([&, i] { workload.read(i, true); });
+    }
+    workload.write(20000, 20240616);
+    workload.stop = true;
+    for (auto &reader : readers) {
+      reader.join();
+    }
+    workload.tree.synchronize();
+
+    if (!workload.failed && workload.tree.verifyTree()) {
+      std::cout << "concurrent readers verified!" << endl;
+    } else {
+      std::cout << "concurrent readers failed" << endl;
+    }
+  }
+
+  // lookups per second against one busy writer, 1 reader up to all cores
+  void scaleReaders() {
+    auto cores = max(1u, thread::hardware_concurrency());
+
+    for (unsigned count = 1;; count = min(2 * count, cores)) {
+      Workload workload;
+      vector<thread> readers;
+
+      thread writer{[&] { workload.write(0, count); }};
+      for (unsigned i = 0; i < count; i++) {
+        readers.emplace_back([&, i] { workload.read(i, false); });
+      }
+      this_thread::sleep_for(chrono::milliseconds(100));
+      workload.stop = true;
+      writer.join();
+      for (auto &reader : readers) {
+        reader.join();
+      }
+
+      std::cout << "concurrent readers: " << count << " threads, "
+                << workload.reads * 10 << " lookups/s" << endl;
+      if (count == cores)
+        break;
+    }
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbConcurrentTree)
+#endif
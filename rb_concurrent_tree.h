@@ -0,0 +1,175 @@
+#ifndef __RB_CONCURRENT_TREE_H__
+#define __RB_CONCURRENT_TREE_H__
+
+#include "rb_epoch.h"
+#include "rb_persistent_tree.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * One writer, any number of lock-free readers. Values are not linked in
+ * place, a rotation could not be published to readers in one store: the
+ * tree is an RbPersistentTree of pointers to them instead, every update
+ * derives a new version by copying the O(log n) nodes on its path, and
+ * publishes it with a single release store. Nodes never change once
+ * published, so readers load the current version with acquire and walk
+ * it with plain loads, never waiting for the writer nor retrying: lookups
+ * are wait-free, and a walk sees the very version it started from.
+ *
+ * A replaced version, with the nodes only it still holds, is freed and a
+ * deleted value handed to `dispose` only once no pinned reader can still
+ * reach them (RbEpoch). Readers pin through their own RbEpoch::Reader on
+ * epoch() and pass the guard to every read, values they get stay valid
+ * while it is held.
+ *
+ * Values of equal keys are told apart, and visited, by address.
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity>
+class RbConcurrentTree {
+  // by key, then by address, so that every value is a key of its own
+  struct Order {
+    bool operator()(T *a, T *b) const {
+      if (compare(keyOf(*a), keyOf(*b)))
+        return true;
+      return !compare(keyOf(*b), keyOf(*a)) && less<>{}(a, b);
+    }
+
+    [[no_unique_address]] Compare compare;
+    [[no_unique_address]] KeyOf keyOf;
+  };
+
+  using Version = RbPersistentTree<T *, T *, Order>;
+
+public:
+  using Value = T;
+  using Guard = RbEpoch::Guard;
+
+  explicit RbConcurrentTree(
+      function<void(Value *)> dispose = [](Value *) {}, size_t readers = 64,
+      Compare compare = Compare{}, KeyOf keyOf = KeyOf{})
+      : order_{compare, keyOf}, published_{new Version{order_}},
+        epoch_{readers}, dispose_{move(dispose)} {}
+  RbConcurrentTree(const RbConcurrentTree &) = delete;
+  RbConcurrentTree &operator=(const RbConcurrentTree &) = delete;
+
+  // no reader may be left, whatever is still retired gets disposed
+  ~RbConcurrentTree() {
+    for (auto &retired : retired_) {
+      release(retired);
+    }
+    delete published_.load(memory_order_relaxed);
+  }
+
+  RbEpoch &epoch() { return epoch_; }
+
+  // writer side, one thread at a time
+
+  RbConcurrentTree &insert(Value *value) {
+    publish(current().insert(value), nullptr);
+    return *this;
+  }
+
+  // `value` is disposed of later, once readers are done with it
+  RbConcurrentTree &erase(Value *value) {
+    publish(current().erase(value), value);
+    return *this;
+  }
+
+  // dispose of what no reader can reach anymore, without waiting
+  void reclaim() {
+    epoch_.tryAdvance();
+
+    size_t done = 0;
+    for (; done < retired_.size() && epoch_.isSafe(retired_[done].epoch);
+         done++) {
+      release(retired_[done]);
+    }
+    retired_.erase(retired_.begin(), retired_.begin() + done);
+  }
+
+  // wait until every retired value is disposed of, like synchronize_rcu
+  void synchronize() {
+    while (!retired_.empty()) {
+      reclaim();
+      if (!retired_.empty())
+        this_thread::yield();
+    }
+  }
+
+  size_t size() const { return current().size(); }
+
+  // writer only, the version readers start from is checked
+  bool verifyTree() const { return current().verifyTree(); }
+
+  // reader side, any thread holding a guard
+
+  // the first value not less than `key`, nullptr if none
+  Value *lowerBound(const Guard &, const Key &key) const {
+    auto bound = published_.load(memory_order_acquire)
+                     ->partitionPoint([&](Value *value) {
+                       return order_.compare(order_.keyOf(*value), key);
+                     });
+    return bound != nullptr ? *bound : nullptr;
+  }
+
+  Value *search(const Guard &guard, const Key &key) const {
+    auto value = lowerBound(guard, key);
+    return value != nullptr && !order_.compare(key, order_.keyOf(*value))
+               ? value
+               : nullptr;
+  }
+
+  bool contains(const Guard &guard, const Key &key) const {
+    return search(guard, key) != nullptr;
+  }
+
+  /*
+   * Visit every value in order, as of the version current when the walk
+   * started: updates made meanwhile are not seen, none is half seen. The
+   * visitor may return false to stop.
+   */
+  template <class F> bool forEachInorder(const Guard &, F &&visit) const {
+    return published_.load(memory_order_acquire)->forEachInorder(visit);
+  }
+
+private:
+  static constexpr size_t ReclaimBatch = 64;
+
+  // a replaced version, and the value it was replaced to erase if any
+  struct Retired {
+    Version *version;
+    Value *value;
+    uint64_t epoch;
+  };
+
+  // only the writer stores the version, it may read it relaxed
+  const Version &current() const {
+    return *published_.load(memory_order_relaxed);
+  }
+
+  void publish(Version &&next, Value *erased) {
+    auto replaced = published_.load(memory_order_relaxed);
+    published_.store(new Version{move(next)}, memory_order_release);
+
+    retired_.push_back({replaced, erased, epoch_.current()});
+    if (retired_.size() >= ReclaimBatch)
+      reclaim();
+  }
+
+  void release(const Retired &retired) {
+    delete retired.version;
+    if (retired.value != nullptr)
+      dispose_(retired.value);
+  }
+
+  Order order_;
+  atomic<Version *> published_;
+  RbEpoch epoch_;
+  function<void(Value *)> dispose_;
+  vector<Retired> retired_;
+};
+#endif
@@ -0,0 +1,111 @@
+#ifndef __RB_EPOCH_H__
+#define __RB_EPOCH_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+/*
+ * Epoch based reclamation. Readers pin the current epoch for as long as
+ * they hold pointers into a shared structure; a writer tags what it
+ * unlinks with the epoch of the moment and frees it only once the epoch
+ * moved on twice, since by then no reader can still be pinned to the
+ * epoch it was reachable in. The epoch moves on when every pinned reader
+ * has caught up with it.
+ *
+ * A reader thread registers once (Reader), then pins around each batch
+ * of reads (Guard). There are at most `readers` Reader objects at any
+ * time, one more waits until a slot frees up.
+ */
+class RbEpoch {
+  // one cache line per reader, pins never bounce each other's lines
+  struct alignas(64) Slot {
+    atomic<uint64_t> pinned{Quiescent};
+    atomic<bool> claimed{false};
+  };
+
+public:
+  static constexpr uint64_t Quiescent = 0;
+
+  class Guard {
+  public:
+    Guard(Guard &&other) : slot_{exchange(other.slot_, nullptr)} {}
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+    ~Guard() {
+      if (slot_ != nullptr)
+        slot_->pinned.store(Quiescent, memory_order_release);
+    }
+
+  private:
+    friend class RbEpoch;
+    explicit Guard(Slot *slot) : slot_{slot} {}
+
+    Slot *slot_;
+  };
+
+  class Reader {
+  public:
+    explicit Reader(RbEpoch &epoch) : epoch_{epoch} {
+      for (size_t i = 0;; i = (i + 1) % epoch.readers_) {
+        auto expected = false;
+        if (epoch.slots_[i].claimed.compare_exchange_strong(expected, true)) {
+          slot_ = &epoch.slots_[i];
+          return;
+        }
+        if (i + 1 == epoch.readers_)
+          this_thread::yield();
+      }
+    }
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+    ~Reader() { slot_->claimed.store(false, memory_order_release); }
+
+    /*
+     * Pin the current epoch, and make sure it still is current once the
+     * pin is visible, or a writer may have freed the epoch we read.
+     */
+    Guard pin() {
+      uint64_t epoch;
+      do {
+        epoch = epoch_.epoch_.load();
+        slot_->pinned.store(epoch);
+      } while (epoch_.epoch_.load() != epoch);
+      return Guard{slot_};
+    }
+
+  private:
+    RbEpoch &epoch_;
+    Slot *slot_;
+  };
+
+  explicit RbEpoch(size_t readers = 64)
+      : readers_{readers}, slots_{make_unique<Slot[]>(readers)} {}
+
+  uint64_t current() const { return epoch_.load(); }
+
+  // move on if no reader is pinned behind, false if one is
+  bool tryAdvance() {
+    auto epoch = epoch_.load();
+    for (size_t i = 0; i < readers_; i++) {
+      auto pinned = slots_[i].pinned.load();
+      if (pinned != Quiescent && pinned != epoch)
+        return false;
+    }
+    epoch_.compare_exchange_strong(epoch, epoch + 1);
+    return true;
+  }
+
+  // whatever was retired at `retired` or before can no longer be reached
+  bool isSafe(uint64_t retired) const { return retired + 2 <= current(); }
+
+private:
+  atomic<uint64_t> epoch_{1};
+  size_t readers_;
+  unique_ptr<Slot[]> slots_;
+};
+#endif
@@ -0,0 +1,121 @@
+#include "rb_finger_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+struct Entry {
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+};
+
+using EntryNode = RbNode<Entry>;
+struct FingerTag {};
+struct PlainTag {};
+using FingerStats = RbTreeStats<FingerTag>;
+using PlainStats = RbTreeStats<PlainTag>;
+
+class TestcaseRbFingerTree : public TestcaseBase {
+public:
+  static constexpr int Count = 20000;
+
+  virtual void testRoutine() override {
+    if (verifyNearlySorted() && verifyDelete()) {
+      std::cout << "finger tree verified!" << endl;
+    } else {
+      std::cout << "finger tree failed" << endl;
+    }
+  }
+
+  template <class Stats> static double meanDepth() {
+    auto stats = Stats::snapshot();
+    double total = 0, count = 0;
+    for (unsigned depth = 0; depth < Stats::MaxDepth; depth++) {
+      total += depth * stats.depths[depth];
+      count += stats.depths[depth];
+    }
+    return count > 0 ? total / count : 0;
+  }
+
+  /*
+   * timestamps late by up to a few dozen ticks; inserts stay a level or
+   * two deep where a descent from the root goes all the way down
+   */
+  bool verifyNearlySorted() {
+    vector<EntryNode> fingerNodes(Count), plainNodes(Count);
+    RbFingerTree<Entry, int, less<>, RbIdentity, RbBaseHook<Entry>,
+                 FingerStats>
+        finger;
+    RbTree<Entry, int, less<>, RbIdentity, RbBaseHook<Entry>, PlainStats>
+        plain;
+    multiset<int> expected;
+    mt19937 rng(20240624);
+
+    FingerStats::reset();
+    PlainStats::reset();
+    for (int i = 0; i < Count; i++) {
+      auto key = 4 * i + static_cast<int>(rng() % 64);
+      fingerNodes[i].key = plainNodes[i].key = key;
+      finger.insertNode(&fingerNodes[i]);
+      plain.insertNode(&plainNodes[i]);
+      expected.insert(key);
+    }
+
+    vector<int> keys;
+    finger.forEachInorder([&](EntryNode *node) { keys.push_back(node->key); });
+    return finger.verifyTree() && ranges::equal(keys, expected) &&
+           finger.last()->key == *expected.rbegin() &&
+           3 * meanDepth<FingerStats>() < meanDepth<PlainStats>();
+  }
+
+  // deleting the fingers, the ends above all, moves them on
+  bool verifyDelete() {
+    vector<EntryNode> nodes(Count);
+    RbFingerTree<Entry, int> tree;
+    multiset<int> expected;
+    mt19937 rng(20240625);
+    auto result = true;
+
+    for (int i = 0; i < Count && result; i++) {
+      auto &node = nodes[i];
+      node.key = i + static_cast<int>(rng() % 16) - (i % 7 == 0 ? i : 0);
+      tree.insertNode(&node);
+      expected.insert(node.key);
+
+      if (i % 3 == 2) {
+        auto pick = rng() % 3;
+        auto gone = pick == 0   ? tree.first()
+                    : pick == 1 ? tree.last()
+                                : &nodes[rng() % i];
+        if (gone->key >= 0) {
+          expected.erase(expected.find(gone->key));
+          tree.deleteNode(gone);
+          gone->key = -1;
+        }
+      }
+      result = tree.size() == expected.size() &&
+               (tree.empty() ? expected.empty()
+                             : tree.first()->key == *expected.begin() &&
+                                   tree.last()->key == *expected.rbegin());
+    }
+
+    vector<int> keys;
+    tree.forEachInorder([&](EntryNode *node) { keys.push_back(node->key); });
+    tree.clear();
+    return result && ranges::equal(keys, expected) && tree.empty();
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbFingerTree)
+#endif
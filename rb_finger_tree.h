@@ -0,0 +1,105 @@
+#ifndef __RB_FINGER_TREE_H__
+#define __RB_FINGER_TREE_H__
+
+#include "rb_tree.h"
+
+using namespace std;
+
+/*
+ * Tree for keys arriving nearly in order, timestamps say. It keeps two
+ * fingers into itself: the largest value, so an append links right below
+ * it after a single comparison, and the last value inserted, from which
+ * any other insert starts through insertHint(). Either way the descent
+ * from the root is skipped, and rebalancing is O(1) amortized, so both
+ * inserts cost O(1) for keys close to the previous one.
+ *
+ * The smallest value is kept too, first() and last() are O(1) rather than
+ * a walk down a spine. deleteNode() moves whichever of them it unlinks
+ * to the neighbour, O(1) for the ends. So is the count, for size().
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity,
+          class Hook = RbBaseHook<T>, class Stats = RbNoStats>
+class RbFingerTree : private RbTree<T, Key, Compare, KeyOf, Hook, Stats> {
+public:
+  using Tree = RbTree<T, Key, Compare, KeyOf, Hook, Stats>;
+  using Node = typename Tree::Node;
+  using Value = typename Tree::Value;
+
+  RbFingerTree(Compare compare = Compare{}, KeyOf keyOf = KeyOf{})
+      : Tree{nullptr, compare, keyOf} {}
+
+  RbFingerTree &insertNode(Value *value) {
+    auto node = Hook::toNode(value);
+
+    if (last_ == nullptr) {
+      Tree::insertNode(value);
+      first_ = last_ = node;
+    } else if (!this->compareNodes(node, last_)) {
+      RbStatTimer<Stats> timer{RbInsertOp};
+      Stats::descent(1);
+      this->linkNode(last_, RightChild, node);
+      last_ = node;
+    } else {
+      Tree::insertHint(Hook::toValue(finger_ ? finger_ : last_), value);
+      // a key equal to the smallest may land on either side of it
+      if (this->compareNodes(node, first_) ||
+          (!this->compareNodes(first_, node) && node->getNodeNext() == first_))
+        first_ = node;
+    }
+    finger_ = node;
+    size_++;
+    return *this;
+  }
+
+  RbFingerTree &deleteNode(Value *value) {
+    auto node = Hook::toNode(value);
+
+    if (node == first_)
+      first_ = node->getNodeNext();
+    if (node == last_)
+      last_ = node->getNodePrev();
+    if (node == finger_)
+      finger_ = nullptr;
+    Tree::deleteNode(value);
+    size_--;
+    return *this;
+  }
+
+  // forget every node, the tree never owned them
+  void clear() {
+    Tree::clear();
+    first_ = last_ = finger_ = nullptr;
+    size_ = 0;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // smallest and largest value, nullptr if the tree is empty
+  Value *first() const { return valueOf(first_); }
+  Value *last() const { return valueOf(last_); }
+
+  using Tree::begin;
+  using Tree::contains;
+  using Tree::end;
+  using Tree::forEachInorder;
+  using Tree::lowerBound;
+  using Tree::search;
+  using Tree::upperBound;
+  using Tree::verifyTree;
+
+protected:
+  // for queues built on top, which compare keys against their values
+  using Tree::compareKeyNode;
+
+private:
+  static Value *valueOf(Node *node) {
+    return node != nullptr ? Hook::toValue(node) : nullptr;
+  }
+
+  Node *first_ = nullptr;
+  Node *last_ = nullptr;
+  Node *finger_ = nullptr;
+  size_t size_ = 0;
+};
+#endif
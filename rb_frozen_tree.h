@@ -0,0 +1,287 @@
+#ifndef __RB_FROZEN_TREE_H__
+#define __RB_FROZEN_TREE_H__
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// hands out storage aligned to `Alignment`, a cache line by default
+template <class T, size_t Alignment = 64> struct RbAlignedAllocator {
+  using value_type = T;
+
+  template <class U> struct rebind {
+    using other = RbAlignedAllocator<U, Alignment>;
+  };
+
+  RbAlignedAllocator() = default;
+  template <class U>
+  RbAlignedAllocator(const RbAlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t size) {
+    return static_cast<T *>(
+        ::operator new(size * sizeof(T), align_val_t{Alignment}));
+  }
+  void deallocate(T *p, size_t) {
+    ::operator delete(p, align_val_t{Alignment});
+  }
+
+  bool operator==(const RbAlignedAllocator &) const { return true; }
+};
+
+/*
+ * Read-only snapshot of a sorted sequence, laid out for lookups: keys sit
+ * in Eytzinger (BFS) order, children of slot k at 2k and 2k + 1, so a
+ * descent walks one array from left to right, with no pointer to chase
+ * and no branch to mispredict, prefetching the cache line holding the
+ * slots a few levels further down. The values are kept in order beside
+ * it for range scans, every slot holding the 32-bit rank of its own, so
+ * a snapshot takes up to MaxSize = 2^32 - 1 values, rebuild() throwing
+ * rather than truncating ranks past that.
+ *
+ * Entry: the key copied out of every value, small and trivially copyable
+ *        so that a cache line holds several; a tree whose KeyOf hands back
+ *        the whole payload, RbIdentity, freezes only if that is as small
+ * Value: what lookups hand back a pointer to
+ * Compare: same strict weak order the source was sorted with
+ */
+template <class Entry, class Value, class Compare = less<>>
+class RbFrozenTree {
+public:
+  static_assert(is_trivially_copyable_v<Entry> &&
+                    is_default_constructible_v<Entry> && sizeof(Entry) <= 16,
+                "frozen keys are copied into every slot, keep them small");
+
+  // values a snapshot takes at most, ranks being 32-bit
+  static constexpr size_t MaxSize = UINT32_MAX;
+
+  RbFrozenTree(Compare compare = Compare{}) : compare_{compare} {}
+
+  /*
+   * Drop the current contents and take [first, last), which must already
+   * be sorted, `keyOf` extracting the entry of each value. The storage is
+   * reused, so refreezing costs O(n) and no allocation once grown. Past
+   * MaxSize values this throws length_error, leaving the snapshot empty.
+   */
+  template <class It, class KeyOf>
+  void rebuild(It first, It last, KeyOf &&keyOf) {
+    values_.clear();
+    for (; first != last; ++first) {
+      if (values_.size() == MaxSize) {
+        values_.clear();
+        throw length_error("RbFrozenTree: too many values for 32-bit ranks");
+      }
+      values_.push_back(&*first);
+    }
+
+    entries_.resize(values_.size() + 1);
+    ranks_.resize(values_.size() + 1);
+    size_t rank = 0;
+    layout(1, rank, keyOf);
+  }
+
+  size_t size() const { return values_.size(); }
+  bool empty() const { return values_.empty(); }
+
+  // first value not less than key, nullptr if none
+  template <class Key> Value *lowerBound(const Key &key) const {
+    return valueAt(rankOf(
+        descend([&](const Entry &entry) { return compare_(entry, key); })));
+  }
+
+  // first value greater than key, nullptr if none
+  template <class Key> Value *upperBound(const Key &key) const {
+    return valueAt(rankOf(
+        descend([&](const Entry &entry) { return !compare_(key, entry); })));
+  }
+
+  template <class Key> Value *search(const Key &key) const {
+    return matchOf(
+        descend([&](const Entry &entry) { return compare_(entry, key); }),
+        key);
+  }
+
+  /*
+   * search() for a batch, results[i] for keys[i]. Every descent is just
+   * as long, so a group of them advances level by level side by side and
+   * their cache misses overlap. 32-bit integer entries under less<> go
+   * eight at a time through AVX2 gathers when the CPU has them.
+   */
+  template <class Key>
+  void searchBatch(span<const Key> keys, span<Value *> results) const {
+    size_t done = 0;
+#if defined(__x86_64__)
+    if constexpr (Vectorizable<Key>) {
+      if (size() < MaxVectorSize && __builtin_cpu_supports("avx2"))
+        done = searchBatchAvx2(keys, results);
+    }
+#endif
+
+    for (; done < keys.size(); done += Group) {
+      auto count = min(Group, keys.size() - done);
+      size_t slots[Group];
+      auto key = [&](size_t lane) -> const Key & { return keys[done + lane]; };
+
+      fill_n(slots, count, 1);
+      for (auto level = bit_width(size()); level > 1; level--) {
+        for (size_t lane = 0; lane < count; lane++) {
+          auto slot = slots[lane];
+          __builtin_prefetch(entries_.data() + slot * Stride);
+          slots[lane] = 2 * slot + compare_(entries_[slot], key(lane));
+        }
+      }
+      if (!empty()) {
+        // the deepest level is partial, past its end is a right turn
+        for (size_t lane = 0; lane < count; lane++) {
+          auto slot = slots[lane];
+          slots[lane] = 2 * slot + (slot > size() ||
+                                    compare_(entries_[slot], key(lane)));
+        }
+      }
+      for (size_t lane = 0; lane < count; lane++) {
+        results[done + lane] = matchOf(turnOf(slots[lane]), key(lane));
+      }
+    }
+  }
+
+  template <class Key> bool contains(const Key &key) const {
+    return search(key) != nullptr;
+  }
+
+  // values whose key falls in [lo, hi), in order
+  template <class Key>
+  span<Value *const> range(const Key &lo, const Key &hi) const {
+    auto begin = rankOf(
+        descend([&](const Entry &entry) { return compare_(entry, lo); }));
+    auto end = rankOf(
+        descend([&](const Entry &entry) { return compare_(entry, hi); }));
+    return {values_.data() + begin, max(begin, end) - begin};
+  }
+
+  // every value in order
+  span<Value *const> values() const { return values_; }
+
+private:
+  // slots per cache line, prefetched log2(Stride) levels ahead
+  static constexpr size_t Stride =
+      sizeof(Entry) < 64 ? bit_floor(64 / sizeof(Entry)) : 1;
+
+  // descents advanced side by side by searchBatch()
+  static constexpr size_t Group = 16;
+
+  // AVX2 slots are 32-bit lanes and go down to twice the size
+  static constexpr size_t MaxVectorSize = size_t{1} << 29;
+
+  template <class Key>
+  static constexpr bool Vectorizable =
+      is_same_v<Entry, int32_t> && is_same_v<Key, int32_t> &&
+      (is_same_v<Compare, less<>> || is_same_v<Compare, less<int32_t>>);
+
+#if defined(__x86_64__)
+  // eight lanes per round, the leftovers are for the caller
+  template <class Key>
+  __attribute__((target("avx2"))) size_t
+  searchBatchAvx2(span<const Key> keys, span<Value *> results) const {
+    auto entries = reinterpret_cast<const int *>(entries_.data());
+    auto depth = bit_width(size());
+    auto one = _mm256_set1_epi32(1);
+    auto past = _mm256_set1_epi32(static_cast<int>(size()) + 1);
+    size_t done = 0;
+
+    for (; done + 8 <= keys.size(); done += 8) {
+      auto key = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(keys.data() + done));
+      auto slot = one;
+
+      // 2 * slot + (entry < key), a true comparison being -1
+      for (size_t level = 1; level < depth; level++) {
+        auto entry = _mm256_i32gather_epi32(entries, slot, 4);
+        slot = _mm256_sub_epi32(_mm256_add_epi32(slot, slot),
+                                _mm256_cmpgt_epi32(key, entry));
+      }
+      if (depth > 0) {
+        auto inside = _mm256_cmpgt_epi32(past, slot);
+        auto entry = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                                                 entries, slot, inside, 4);
+        auto right = _mm256_or_si256(
+            _mm256_xor_si256(inside, _mm256_set1_epi32(-1)),
+            _mm256_cmpgt_epi32(key, entry));
+        slot = _mm256_sub_epi32(_mm256_add_epi32(slot, slot), right);
+      }
+
+      alignas(32) uint32_t slots[8];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(slots), slot);
+      for (size_t lane = 0; lane < 8; lane++) {
+        results[done + lane] = matchOf(turnOf(slots[lane]), keys[done + lane]);
+      }
+    }
+    return done;
+  }
+#endif
+
+  // fill the subtree of `slot` from the sorted values, in order
+  template <class KeyOf>
+  void layout(size_t slot, size_t &rank, KeyOf &keyOf) {
+    if (slot >= entries_.size())
+      return;
+
+    layout(2 * slot, rank, keyOf);
+    entries_[slot] = keyOf(*values_[rank]);
+    ranks_[slot] = static_cast<uint32_t>(rank++);
+    layout(2 * slot + 1, rank, keyOf);
+  }
+
+  /*
+   * The first slot whose entry fails `goesRight`, 0 if none does: the
+   * descent records right turns as 1 bits, the last left turn is the
+   * answer once those trailing ones (and that zero) are shifted out. An
+   * extra right turn past the end thus changes nothing.
+   */
+  template <class F> size_t descend(F &&goesRight) const {
+    size_t slot = 1;
+    auto size = values_.size();
+
+    while (slot <= size) {
+      __builtin_prefetch(entries_.data() + slot * Stride);
+      slot = 2 * slot + goesRight(entries_[slot]);
+    }
+    return turnOf(slot);
+  }
+
+  // the slot of the last left turn on a finished descent, 0 if none
+  static size_t turnOf(size_t slot) { return slot >> (countr_one(slot) + 1); }
+
+  template <class Key> Value *matchOf(size_t slot, const Key &key) const {
+    return slot != 0 && !compare_(key, entries_[slot]) ? values_[ranks_[slot]]
+                                                       : nullptr;
+  }
+
+  size_t rankOf(size_t slot) const {
+    return slot != 0 ? ranks_[slot] : values_.size();
+  }
+
+  Value *valueAt(size_t rank) const {
+    return rank < values_.size() ? values_[rank] : nullptr;
+  }
+
+  // slot 0 is a placeholder, the root is slot 1
+  vector<Entry, RbAlignedAllocator<Entry>> entries_;
+  vector<uint32_t> ranks_;
+  static_assert(MaxSize - 1 <= numeric_limits<uint32_t>::max(),
+                "every rank below MaxSize must fit a slot of ranks_");
+  vector<Value *> values_;
+  [[no_unique_address]] Compare compare_;
+};
+#endif
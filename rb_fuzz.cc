@@ -0,0 +1,130 @@
+#include "rb_fuzz.h"
+#include "rb_tree.h"
+
+using namespace std;
+
+#if defined(_TC_ENABLE) || defined(_FUZZ_ENABLE)
+
+#include "testcase.h"
+#include <deque>
+
+namespace {
+struct Entry {
+  int key;
+};
+
+struct EntryKey {
+  int operator()(const Entry &entry) const { return entry.key; }
+};
+
+using EntryNode = RbNode<Entry>;
+
+// nodes come from a pool and go back to it once unlinked
+class TreeSubject {
+public:
+  i64 apply(const RbFuzzOp &op) {
+    auto found = [](EntryNode *node) -> i64 {
+      return node != nullptr ? node->key : -1;
+    };
+
+    switch (op.kind) {
+    case RbFuzzOp::Insert:
+      tree_.insertNode(take(op.key));
+      return 1;
+    case RbFuzzOp::Erase:
+      return erase(op.key);
+    case RbFuzzOp::Contains:
+      return tree_.contains(op.key);
+    case RbFuzzOp::LowerBound:
+      return found(tree_.lowerBound(op.key));
+    case RbFuzzOp::UpperBound:
+      return found(tree_.upperBound(op.key));
+    case RbFuzzOp::First:
+      return found(tree_.first());
+    default:
+      return found(tree_.last());
+    }
+  }
+
+  bool check(const multiset<int> &model) {
+    auto same = [](const EntryNode &node, int key) { return node.key == key; };
+    return tree_.verifyTree() &&
+           equal(tree_.begin(), tree_.end(), model.begin(), model.end(), same);
+  }
+
+protected:
+  virtual i64 erase(int key) {
+    auto node = tree_.search(key);
+    if (node == nullptr)
+      return 0;
+    tree_.deleteNode(node);
+    free_.push_back(node);
+    return 1;
+  }
+
+  EntryNode *take(int key) {
+    EntryNode *node;
+    if (free_.empty()) {
+      node = &pool_.emplace_back();
+    } else {
+      node = free_.back();
+      free_.pop_back();
+      *node = EntryNode{};
+    }
+    node->key = key;
+    return node;
+  }
+
+  RbTree<Entry, int, less<>, EntryKey> tree_;
+  deque<EntryNode> pool_;
+  vector<EntryNode *> free_;
+};
+
+class FuzzRbTree : public TestcaseBase {
+public:
+  virtual void testRoutine() override {
+    auto report = RbFuzzer<TreeSubject>::run(RbFuzzConfig::get());
+    RbFuzzer<TreeSubject>::print(report);
+
+    auto result = report.failures.empty();
+#ifdef _TC_ENABLE
+    result = result && verifyShrink();
+#endif
+    if (result) {
+      std::cout << "fuzz verified!" << endl;
+    } else {
+      std::cout << "fuzz failed" << endl;
+    }
+  }
+
+#ifdef _TC_ENABLE
+  // claims to erase multiples of 13 but keeps them
+  class LossySubject : public TreeSubject {
+  protected:
+    virtual i64 erase(int key) override {
+      return key % 13 == 0 ? tree_.contains(key) : TreeSubject::erase(key);
+    }
+  };
+
+  // the planted bug is caught and cut down to an insert and its erase
+  bool verifyShrink() {
+    RbFuzzConfig config;
+    config.ops = 2000;
+    config.seeds = 2;
+    config.checkEvery = 64;
+
+    auto report = RbFuzzer<LossySubject>::run(config);
+    auto shrunk = [](const RbFuzzer<LossySubject>::Failure &failure) {
+      auto &ops = failure.ops;
+      return ops.size() == 2 && ops[0].kind == RbFuzzOp::Insert &&
+             ops[1].kind == RbFuzzOp::Erase && ops[0].key == ops[1].key &&
+             ops[0].key % 13 == 0;
+    };
+    return report.failures.size() == config.seeds &&
+           all_of(report.failures.begin(), report.failures.end(), shrunk);
+  }
+#endif
+};
+} // namespace
+INIT_CASE(FuzzRbTree)
+#endif
@@ -0,0 +1,261 @@
+#ifndef __RB_FUZZ_H__
+#define __RB_FUZZ_H__
+
+#include "types.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <set>
+#include <span>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Differential fuzzing helpers: a structure under test and std::multiset
+ * take the same seeded stream of operations in lock-step and must give
+ * the same answer to each. Runs are set up through the environment, as
+ * the cases take no arguments:
+ *   RB_FUZZ_OPS    operations per seed
+ *   RB_FUZZ_SEEDS  seeds to run, spread over all cores
+ *   RB_FUZZ_SEED   first seed, the others following it
+ *   RB_FUZZ_CHECK  full check of the structure every so many operations
+ * The fuzz target defaults to millions of operations; test builds, whose
+ * trees verify themselves after every update anyway, to a short run.
+ */
+struct RbFuzzConfig {
+#ifdef _FUZZ_ENABLE
+  size_t ops = 1000000;
+  size_t seeds = max(1u, thread::hardware_concurrency()) * 2;
+#else
+  size_t ops = 5000;
+  size_t seeds = 4;
+#endif
+  u64 seed = 20240623;
+  size_t checkEvery = 4096;
+
+  static const RbFuzzConfig &get() {
+    static const RbFuzzConfig config = [] {
+      RbFuzzConfig config;
+      if (auto ops = getenv("RB_FUZZ_OPS"))
+        config.ops = strtoull(ops, nullptr, 10);
+      if (auto seeds = getenv("RB_FUZZ_SEEDS"))
+        config.seeds = strtoull(seeds, nullptr, 10);
+      if (auto seed = getenv("RB_FUZZ_SEED"))
+        config.seed = strtoull(seed, nullptr, 10);
+      if (auto check = getenv("RB_FUZZ_CHECK"))
+        config.checkEvery = max<size_t>(1, strtoull(check, nullptr, 10));
+      return config;
+    }();
+    return config;
+  }
+};
+
+/*
+ * One operation and the answer expected of it, -1 standing for nothing
+ * found: Insert 1, Erase 1 if a value was there to unlink else 0,
+ * Contains 1 or 0, the bounds and ends the key found.
+ */
+struct RbFuzzOp {
+  enum Kind : u8 {
+    Insert,
+    Erase,
+    Contains,
+    LowerBound,
+    UpperBound,
+    First,
+    Last,
+    Kinds
+  };
+
+  static constexpr const char *Names[] = {
+      "insert", "erase", "contains", "lower_bound", "upper_bound", "first",
+      "last"};
+
+  Kind kind;
+  int key;
+};
+
+/*
+ * Drives a `Subject` against the reference. A subject is built empty and
+ * has
+ *   i64 apply(const RbFuzzOp &)        the answer to one operation
+ *   bool check(const multiset<int> &)  invariants hold and contents match
+ *                                      the reference
+ * A mismatch is replayed from scratch while chunks of the sequence are
+ * dropped for as long as it still fails, leaving a sequence none of
+ * whose operations can be removed on its own.
+ */
+template <class Subject> class RbFuzzer {
+public:
+  static constexpr size_t Passed = SIZE_MAX;
+
+  struct Failure {
+    u64 seed;
+    vector<RbFuzzOp> ops;
+  };
+
+  struct Report {
+    size_t seeds = 0;
+    size_t ops = 0;
+    double seconds = 0;
+    vector<Failure> failures;
+
+    double opsPerSecond() const { return seconds > 0 ? ops / seconds : 0; }
+  };
+
+  /*
+   * Keys come from a range set by the seed, 8 up to 4K wide, so some
+   * seeds pile up duplicates and others spread out. Updates alternate
+   * between phases of growth and of shrinkage, every run going through
+   * empty, small and large trees alike.
+   */
+  static vector<RbFuzzOp> generate(u64 seed, size_t n) {
+    constexpr size_t Phase = 2048;
+    mt19937_64 rng{seed};
+    int range = 8 << seed % 10;
+    vector<RbFuzzOp> ops(n);
+
+    for (size_t i = 0; i < n; i++) {
+      auto growing = i / Phase % 2 == 0;
+      auto roll = rng() % 100;
+      auto kind = static_cast<RbFuzzOp::Kind>(RbFuzzOp::Contains + roll % 5);
+      if (roll < (growing ? 45u : 20u)) {
+        kind = RbFuzzOp::Insert;
+      } else if (roll < 60) {
+        kind = RbFuzzOp::Erase;
+      }
+      ops[i] = {kind, static_cast<int>(rng() % range)};
+    }
+    return ops;
+  }
+
+  static i64 expect(multiset<int> &model, const RbFuzzOp &op) {
+    auto found = [&](multiset<int>::iterator it) -> i64 {
+      return it != model.end() ? *it : -1;
+    };
+
+    switch (op.kind) {
+    case RbFuzzOp::Insert:
+      model.insert(op.key);
+      return 1;
+    case RbFuzzOp::Erase: {
+      auto it = model.find(op.key);
+      if (it == model.end())
+        return 0;
+      model.erase(it);
+      return 1;
+    }
+    case RbFuzzOp::Contains:
+      return model.contains(op.key);
+    case RbFuzzOp::LowerBound:
+      return found(model.lower_bound(op.key));
+    case RbFuzzOp::UpperBound:
+      return found(model.upper_bound(op.key));
+    case RbFuzzOp::First:
+      return model.empty() ? -1 : *model.begin();
+    default:
+      return model.empty() ? -1 : *model.rbegin();
+    }
+  }
+
+  /*
+   * Run `ops` on a fresh subject, a full check every `checkEvery` and
+   * after the last; the index of the operation after which they parted,
+   * Passed if they never did
+   */
+  static size_t replay(span<const RbFuzzOp> ops, size_t checkEvery) {
+    Subject subject;
+    multiset<int> model;
+
+    for (size_t i = 0; i < ops.size(); i++) {
+      if (subject.apply(ops[i]) != expect(model, ops[i]))
+        return i;
+      if (((i + 1) % checkEvery == 0 || i + 1 == ops.size()) &&
+          !subject.check(model))
+        return i;
+    }
+    return Passed;
+  }
+
+  // `ops` fails at `failed`; drop halves, quarters.. down to single ops
+  static vector<RbFuzzOp> shrink(span<const RbFuzzOp> ops, size_t failed,
+                                 size_t checkEvery) {
+    vector<RbFuzzOp> shrunk{ops.begin(), ops.begin() + failed + 1};
+    vector<RbFuzzOp> candidate;
+
+    for (auto chunk = shrunk.size() / 2; chunk > 0; chunk /= 2) {
+      for (size_t start = 0; start < shrunk.size();) {
+        candidate.assign(shrunk.begin(), shrunk.begin() + start);
+        candidate.insert(candidate.end(),
+                         shrunk.begin() + min(shrunk.size(), start + chunk),
+                         shrunk.end());
+        auto at = replay(candidate, checkEvery);
+        if (at != Passed) {
+          candidate.resize(at + 1);
+          shrunk.swap(candidate);
+        } else {
+          start += chunk;
+        }
+      }
+    }
+    return shrunk;
+  }
+
+  // the seeds of `config` on one thread per core, each checked on its own
+  static Report run(const RbFuzzConfig &config) {
+    Report report;
+    atomic<size_t> next = 0;
+    mutex lock;
+    auto workers = min<size_t>(max(1u, thread::hardware_concurrency()),
+                               config.seeds);
+    vector<thread> threads;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t w = 0; w < workers; w++) {
+      threads.emplace_back([&] {
+        for (auto i = next++; i < config.seeds; i = next++) {
+          auto seed = config.seed + i;
+          auto ops = generate(seed, config.ops);
+          auto failed = replay(ops, config.checkEvery);
+          if (failed == Passed)
+            continue;
+
+          auto shrunk = shrink(ops, failed, config.checkEvery);
+          lock_guard guard{lock};
+          report.failures.push_back({seed, move(shrunk)});
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() -
+                                              start)
+                         .count();
+    report.seeds = config.seeds;
+    report.ops = config.seeds * config.ops;
+    return report;
+  }
+
+  static void print(const Report &report) {
+    printf("fuzz: %zu seeds, %zu ops, %.0f ops/s\n", report.seeds, report.ops,
+           report.opsPerSecond());
+    for (auto &failure : report.failures) {
+      printf("fuzz: seed %llu fails after %zu ops:\n",
+             static_cast<unsigned long long>(failure.seed),
+             failure.ops.size());
+      for (auto &op : failure.ops) {
+        printf("  %s %d\n", RbFuzzOp::Names[op.kind], op.key);
+      }
+    }
+    fflush(stdout);
+  }
+};
+#endif
@@ -0,0 +1,81 @@
+#include "rb_interval_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+struct Reservation {
+  int get() const { return start; }
+
+  int start, end;
+};
+
+using ReservationNode =
+    RbNode<Reservation, RbIntervalAugment<int, RbIntervalMembers>>;
+
+class TestcaseRbIntervalTree : public TestcaseBase {
+public:
+  virtual void testRoutine() override {
+    RbIntervalTree<Reservation, int> tree;
+    vector<ReservationNode> nodes(2000);
+    mt19937 rng(20240601);
+    auto result = true;
+
+    for (auto &node : nodes) {
+      node.start = rng() % 10000;
+      node.end = node.start + 1 + rng() % 200;
+      tree.insertNode(&node);
+    }
+    for (size_t i = 0; i < nodes.size(); i += 4) {
+      tree.deleteNode(&nodes[i]);
+    }
+
+    auto linked = [&](size_t i) { return i % 4 != 0; };
+    auto overlaps = [](const Reservation &r, int lo, int hi) {
+      return r.start < hi && lo < r.end;
+    };
+
+    for (int query = 0; query < 500 && result; query++) {
+      int lo = rng() % 10300 - 100, hi = lo + rng() % 300;
+      size_t expected = 0, stabbed = 0, visited = 0;
+      auto previous = numeric_limits<int>::lowest();
+
+      for (size_t i = 0; i < nodes.size(); i++) {
+        expected += linked(i) && overlaps(nodes[i], lo, hi);
+        stabbed += linked(i) && overlaps(nodes[i], lo, lo + 1);
+      }
+      tree.forEachOverlap(lo, hi, [&](ReservationNode *node) {
+        result = result && overlaps(*node, lo, hi) && previous <= node->start;
+        previous = node->start;
+        visited++;
+      });
+
+      auto any = tree.findAnyOverlap(lo, hi);
+      if (visited != expected || tree.countStab(lo) != stabbed ||
+          (any == nullptr) != (expected == 0) ||
+          (any != nullptr && !overlaps(*any, lo, hi))) {
+        result = false;
+      }
+    }
+
+    // early exit after the first hit
+    size_t hits = 0;
+    tree.forEachOverlap(0, 10000,
+                        [&](ReservationNode *) { return ++hits < 1; });
+
+    if (result && hits == 1 && tree.verifyTree()) {
+      std::cout << "interval tree verified!" << endl;
+    } else {
+      std::cout << "interval tree failed" << endl;
+    }
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbIntervalTree)
+#endif
@@ -0,0 +1,120 @@
+#ifndef __RB_INTERVAL_TREE_H__
+#define __RB_INTERVAL_TREE_H__
+
+#include "rb_tree.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+// default bounds policy: the payload carries public `start` and `end`
+struct RbIntervalMembers {
+  template <class T> static auto start(const T &value) { return value.start; }
+  template <class T> static auto end(const T &value) { return value.end; }
+};
+
+// intervals are ordered by their start
+template <class Bounds> struct RbIntervalStart {
+  template <class T> auto operator()(const T &value) const {
+    return Bounds::start(value);
+  }
+};
+
+// the largest end point of a subtree
+template <class Point, class Bounds> struct RbIntervalAugment {
+  using Summary = Point;
+  static constexpr bool Enabled = true;
+
+  static Summary identity() { return numeric_limits<Point>::lowest(); }
+  static Summary combine(Summary a, Summary b) { return max(a, b); }
+  template <class T> static Summary lift(const T &value) {
+    return Bounds::end(value);
+  }
+};
+
+/*
+ * Interval tree over half-open [start, end) payloads: an RbTree keyed by
+ * start whose nodes also keep the largest end of their subtree, so every
+ * subtree ending at or before a query can be skipped. The usual RbTree
+ * API (insertNode, deleteNode, iterators, lookups by start) applies.
+ */
+template <class T, class Point, class Bounds = RbIntervalMembers,
+          class Hook = RbBaseHook<T, RbIntervalAugment<Point, Bounds>>>
+class RbIntervalTree
+    : public RbTree<T, Point, less<>, RbIntervalStart<Bounds>, Hook> {
+public:
+  using Tree = RbTree<T, Point, less<>, RbIntervalStart<Bounds>, Hook>;
+  using Node = typename Tree::Node;
+  using Value = typename Tree::Value;
+
+  // any interval overlapping [lo, hi), nullptr if none, O(log n)
+  Value *findAnyOverlap(Point lo, Point hi) {
+    auto node = this->getRootNode();
+
+    while (node != nullptr) {
+      auto &payload = this->payloadOf(node);
+      if (Bounds::start(payload) < hi && lo < Bounds::end(payload))
+        return Hook::toValue(node);
+
+      /*
+       * if the left subtree reaches past lo but holds no overlap, its
+       * longest interval starts at or after hi, and so does everything
+       * on the right: going left is never a wrong turn
+       */
+      auto left = node->getNodeChild(LeftChild);
+      node = left != nullptr && lo < left->getNodeSummary()
+                 ? left
+                 : node->getNodeChild(RightChild);
+    }
+    return nullptr;
+  }
+
+  /*
+   * Visit every interval overlapping [lo, hi) in start order. Every
+   * subtree the walk enters holds some interval ending after lo, not
+   * necessarily one starting before hi, so it is O(min(n, k log n)) for
+   * k reported intervals rather than O(log n + k). As with forEach*(),
+   * the visitor may return false to stop early.
+   */
+  template <class F> bool forEachOverlap(Point lo, Point hi, F &&visit) {
+    return visitMatches(
+        this->getRootNode(), lo, [&](Point start) { return start < hi; },
+        visit);
+  }
+
+  // visit every interval containing `point`, a stabbing query
+  template <class F> bool forEachStab(Point point, F &&visit) {
+    return visitMatches(
+        this->getRootNode(), point,
+        [&](Point start) { return !(point < start); }, visit);
+  }
+
+  // stabbing count, O(min(n, k log n)) as for forEachOverlap()
+  size_t countStab(Point point) {
+    size_t count = 0;
+    forEachStab(point, [&](Value *) { count++; });
+    return count;
+  }
+
+private:
+  /*
+   * in-order walk of the intervals ending after `lo` and passing
+   * `startOk`, pruned by the subtree max end on the way down and by the
+   * start order on the way right
+   */
+  template <class S, class F>
+  bool visitMatches(Node *node, Point lo, const S &startOk, F &visit) {
+    if (node == nullptr || !(lo < node->getNodeSummary()))
+      return true;
+    if (!visitMatches(node->getNodeChild(LeftChild), lo, startOk, visit))
+      return false;
+
+    auto &payload = this->payloadOf(node);
+    if (!startOk(Bounds::start(payload)))
+      return true;
+    if (lo < Bounds::end(payload) && !Tree::visitNode(visit, node))
+      return false;
+    return visitMatches(node->getNodeChild(RightChild), lo, startOk, visit);
+  }
+};
+#endif
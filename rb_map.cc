@@ -0,0 +1,161 @@
+#include "rb_map.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+
+namespace {
+// forwards to new/delete, counting the calls
+class CountingResource : public pmr::memory_resource {
+public:
+  size_t allocations = 0;
+  size_t live = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    allocations++;
+    live++;
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    live--;
+    pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+class TestcaseRbMap : public TestcaseBase {
+public:
+  virtual void testRoutine() override {
+    verifyMap();
+    verifySet();
+    verifySlab();
+  }
+
+  void verifyMap() {
+    RbMap<int, long> map;
+    std::map<int, long> expected;
+    mt19937 rng(20240610);
+    auto result = true;
+
+    for (int i = 0; i < 3000; i++) {
+      int key = rng() % 1000;
+      switch (rng() % 4) {
+      case 0:
+        map[key] += i;
+        expected[key] += i;
+        break;
+      case 1:
+        result = result && map.tryEmplace(key, i).second ==
+                               expected.try_emplace(key, i).second;
+        break;
+      case 2:
+        result = result && map.erase(key) == expected.erase(key);
+        break;
+      default: {
+        auto it = map.lowerBound(key);
+        auto bound = expected.lower_bound(key);
+        result = result && (it == map.end()) == (bound == expected.end()) &&
+                 (it == map.end() || *it == *bound);
+      }
+      }
+    }
+
+    // erase through iterators, every other one
+    for (auto it = map.begin(); it != map.end(); ++it) {
+      expected.erase(it->first);
+      it = map.erase(it);
+      if (it == map.end())
+        break;
+    }
+
+    auto same = [&](auto &map) {
+      return map.size() == expected.size() &&
+             equal(map.begin(), map.end(), expected.begin(), expected.end());
+    };
+
+    auto copy = map;
+    auto moved = move(map);
+    copy.insert({-1, -1});
+    if (result && same(moved) && map.empty() && map.begin() == map.end() &&
+        copy.size() == expected.size() + 1 && copy.contains(-1) &&
+        !moved.contains(-1)) {
+      std::cout << "map verified!" << endl;
+    } else {
+      std::cout << "map failed" << endl;
+    }
+  }
+
+  void verifySet() {
+    RbSet<string> set;
+    std::set<string> expected;
+    mt19937 rng(20240611);
+    auto result = true;
+
+    for (int i = 0; i < 2000; i++) {
+      auto key = "key-" + to_string(rng() % 500);
+      if (rng() % 3) {
+        auto inserted = set.insert(key).second;
+        result = result && inserted == expected.insert(key).second;
+      } else {
+        result = result && set.erase(key) == expected.erase(key);
+      }
+    }
+
+    auto found = set.find("key-7");
+    auto bound = set.upperBound("key-9");
+    auto expectedBound = expected.upper_bound("key-9");
+    result = result && (found == set.end()) == !expected.contains("key-7") &&
+             (bound == set.end()) == (expectedBound == expected.end()) &&
+             (bound == set.end() || *bound == *expectedBound);
+
+    if (result && set.size() == expected.size() &&
+        equal(set.begin(), set.end(), expected.begin(), expected.end())) {
+      std::cout << "set verified!" << endl;
+    } else {
+      std::cout << "set failed" << endl;
+    }
+  }
+
+  // nodes come from a handful of slabs, erased ones are reused
+  void verifySlab() {
+    CountingResource resource;
+    auto result = true;
+    {
+      RbSet<int> set{&resource};
+      for (int i = 0; i < 4000; i++) {
+        set.insert(i);
+      }
+      auto allocations = resource.allocations;
+      result = allocations <= 12;
+
+      for (int i = 0; i < 4000; i += 2) {
+        set.erase(i);
+      }
+      for (int i = 0; i < 4000; i += 2) {
+        set.insert(i + 10000);
+      }
+      result = result && resource.allocations == allocations &&
+               set.size() == 4000;
+    }
+
+    if (result && resource.live == 0) {
+      std::cout << "slab verified!" << endl;
+    } else {
+      std::cout << "slab failed" << endl;
+    }
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbMap)
+
+#endif
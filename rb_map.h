@@ -0,0 +1,216 @@
+#ifndef __RB_MAP_H__
+#define __RB_MAP_H__
+
+#include "rb_slab.h"
+#include "rb_tree.h"
+#include <tuple>
+
+using namespace std;
+
+/*
+ * Traits describe what an owning container stores in each node and how
+ * it shows up through the iterators:
+ *   Payload     the node payload, ordered by KeyOf
+ *   Reference   what dereferencing an iterator yields
+ *   project()   payload to Reference
+ */
+template <class K, class V> struct RbMapTraits {
+  using Key = K;
+  using Payload = pair<const K, V>;
+  using Reference = Payload &;
+
+  struct KeyOf {
+    const K &operator()(const Payload &payload) const { return payload.first; }
+  };
+
+  static Reference project(Payload &payload) { return payload; }
+};
+
+template <class K> struct RbSetTraits {
+  using Key = K;
+  struct Payload {
+    K key;
+  };
+  using Reference = const K &;
+
+  struct KeyOf {
+    const K &operator()(const Payload &payload) const { return payload.key; }
+  };
+
+  static Reference project(Payload &payload) { return payload.key; }
+};
+
+/*
+ * Owning container on top of the intrusive RbTree: nodes are created in
+ * an RbSlab, so they are packed in a few large blocks instead of one heap
+ * allocation each. Keys are unique. Iterators stay valid until the value
+ * they point to is erased.
+ */
+template <class Traits, class Compare> class RbContainer {
+public:
+  using Key = typename Traits::Key;
+  using Payload = typename Traits::Payload;
+  using Tree = RbTree<Payload, Key, Compare, typename Traits::KeyOf>;
+  using Node = typename Tree::Node;
+
+  class Iterator {
+  public:
+    using iterator_category = bidirectional_iterator_tag;
+    using value_type = remove_cvref_t<typename Traits::Reference>;
+    using difference_type = ptrdiff_t;
+    using pointer = remove_reference_t<typename Traits::Reference> *;
+    using reference = typename Traits::Reference;
+
+    Iterator() = default;
+    explicit Iterator(typename Tree::Iterator it) : it_{it} {}
+
+    reference operator*() const { return Traits::project(*it_); }
+    pointer operator->() const { return &**this; }
+
+    Iterator &operator++() {
+      ++it_;
+      return *this;
+    }
+    Iterator operator++(int) { return Iterator{it_++}; }
+
+    Iterator &operator--() {
+      --it_;
+      return *this;
+    }
+    Iterator operator--(int) { return Iterator{it_--}; }
+
+    bool operator==(const Iterator &other) const { return it_ == other.it_; }
+
+  private:
+    friend class RbContainer;
+    typename Tree::Iterator it_;
+  };
+
+  explicit RbContainer(
+      Compare compare = Compare{},
+      pmr::memory_resource *resource = pmr::get_default_resource())
+      : tree_{nullptr, compare}, slab_{resource} {}
+  explicit RbContainer(pmr::memory_resource *resource)
+      : RbContainer{Compare{}, resource} {}
+
+  // copies keep the comparator but, like pmr containers, not the resource
+  RbContainer(const RbContainer &other) : tree_{other.tree_} {
+    vector<Node *> nodes;
+    nodes.reserve(other.size_);
+    for (auto &payload : other.tree_) {
+      nodes.push_back(slab_.create(static_cast<const Payload &>(payload)));
+    }
+    tree_.buildFromSorted(nodes.begin(), nodes.end());
+    size_ = other.size_;
+  }
+
+  RbContainer(RbContainer &&other)
+      : tree_{other.tree_}, slab_{move(other.slab_)},
+        size_{exchange(other.size_, 0)} {
+    other.tree_.clear();
+  }
+
+  RbContainer &operator=(RbContainer other) {
+    swap(tree_, other.tree_);
+    swap(slab_, other.slab_);
+    swap(size_, other.size_);
+    return *this;
+  }
+
+  ~RbContainer() { clear(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Iterator begin() const { return Iterator{tree_.begin()}; }
+  Iterator end() const { return Iterator{tree_.end()}; }
+
+  Iterator find(const Key &key) { return iteratorOf(tree_.search(key)); }
+  bool contains(const Key &key) { return tree_.contains(key); }
+  Iterator lowerBound(const Key &key) {
+    return iteratorOf(tree_.lowerBound(key));
+  }
+  Iterator upperBound(const Key &key) {
+    return iteratorOf(tree_.upperBound(key));
+  }
+
+  // the iterator following the erased value
+  Iterator erase(Iterator it) {
+    auto value = it.it_.operator->();
+    ++it;
+    tree_.deleteNode(value);
+    slab_.destroy(value);
+    size_--;
+    return it;
+  }
+
+  size_t erase(const Key &key) {
+    auto value = tree_.search(key);
+    if (value == nullptr)
+      return 0;
+
+    erase(iteratorOf(value));
+    return 1;
+  }
+
+  void clear() {
+    tree_.clear([&](Node *node) { slab_.destroy(node); });
+    size_ = 0;
+  }
+
+protected:
+  Iterator iteratorOf(Node *node) const {
+    return Iterator{tree_.iteratorOf(node)};
+  }
+
+  // build a payload from `args` only if `key` is not there yet
+  template <class... Args>
+  pair<Iterator, bool> emplaceUnique(const Key &key, Args &&...args) {
+    if (auto found = tree_.search(key))
+      return {iteratorOf(found), false};
+
+    auto node = slab_.create(forward<Args>(args)...);
+    tree_.insertNode(node);
+    size_++;
+    return {iteratorOf(node), true};
+  }
+
+private:
+  Tree tree_;
+  RbSlab<Node> slab_;
+  size_t size_ = 0;
+};
+
+template <class K, class V, class Compare = less<K>>
+class RbMap : public RbContainer<RbMapTraits<K, V>, Compare> {
+public:
+  using Base = RbContainer<RbMapTraits<K, V>, Compare>;
+  using Iterator = typename Base::Iterator;
+  using Base::Base;
+
+  // like std::map::try_emplace: `args` are left alone if `key` exists
+  template <class... Args>
+  pair<Iterator, bool> tryEmplace(const K &key, Args &&...args) {
+    return this->emplaceUnique(key, piecewise_construct, forward_as_tuple(key),
+                               forward_as_tuple(forward<Args>(args)...));
+  }
+
+  pair<Iterator, bool> insert(const pair<const K, V> &entry) {
+    return this->emplaceUnique(entry.first, entry);
+  }
+
+  V &operator[](const K &key) { return tryEmplace(key).first->second; }
+};
+
+template <class K, class Compare = less<K>>
+class RbSet : public RbContainer<RbSetTraits<K>, Compare> {
+public:
+  using Base = RbContainer<RbSetTraits<K>, Compare>;
+  using Iterator = typename Base::Iterator;
+  using Base::Base;
+
+  pair<Iterator, bool> insert(const K &key) {
+    return this->emplaceUnique(key, key);
+  }
+};
+#endif
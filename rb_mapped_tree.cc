@@ -0,0 +1,197 @@
+#include "rb_mapped_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sys/wait.h>
+
+namespace {
+struct Entry {
+  int get() const { return key; }
+
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+  int value;
+};
+
+using Tree = RbMappedTree<Entry, int>;
+
+class TestcaseRbMappedTree : public TestcaseBase {
+public:
+  static constexpr int KeySpace = 1 << 16;
+
+  virtual void testRoutine() override {
+    char path[] = "/tmp/rb_mapped_tree.XXXXXX";
+    auto fd = mkstemp(path);
+    if (fd < 0) {
+      std::cout << "mapped tree failed" << endl;
+      return;
+    }
+    ::close(fd);
+
+    if (verifyReopen(path) && verifyHeader(path) && verifyArena(path) &&
+        verifyCrash(path)) {
+      std::cout << "mapped tree verified!" << endl;
+    } else {
+      std::cout << "mapped tree failed" << endl;
+    }
+    unlink(path);
+  }
+
+  static bool matches(Tree &tree, const multiset<int> &expected) {
+    auto it = expected.begin();
+    auto same = tree.forEachInorder([&](Entry *entry) {
+      auto match = it != expected.end() && *it == entry->key &&
+                   entry->value == -entry->key;
+      ++it;
+      return match;
+    });
+    return same && it == expected.end() && tree.size() == expected.size() &&
+           tree.verifyTree();
+  }
+
+  // grow from a tiny file, close, and find everything again on reopen
+  bool verifyReopen(const char *path) {
+    mt19937 rng(20240619);
+    multiset<int> expected;
+    size_t capacity;
+
+    {
+      Tree tree{path, 16};
+      for (int i = 0; i < 20000; i++) {
+        int key = rng() % KeySpace;
+        tree.emplace(key, -key);
+        expected.insert(key);
+      }
+      for (int i = 0; i < 5000; i++) {
+        auto it = expected.lower_bound(rng() % KeySpace);
+        if (it == expected.end())
+          continue;
+        tree.erase(tree.search(*it));
+        expected.erase(it);
+      }
+      if (!tree.isOpen() || !matches(tree, expected) || !tree.sync())
+        return false;
+      capacity = tree.capacity();
+    }
+
+    Tree tree{path};
+    if (!tree.isOpen() || !matches(tree, expected))
+      return false;
+
+    // refill the erased slots, the file must not grow for them
+    while (expected.size() < 20000) {
+      int key = rng() % KeySpace;
+      tree.emplace(key, -key);
+      expected.insert(key);
+    }
+    return matches(tree, expected) && tree.capacity() == capacity;
+  }
+
+  static bool patch(const char *path, off_t offset, uint32_t word) {
+    auto fd = ::open(path, O_WRONLY);
+    auto done = pwrite(fd, &word, sizeof(word), offset) == sizeof(word);
+    ::close(fd);
+    return done;
+  }
+
+  static bool peek(const char *path, off_t offset, uint32_t &word) {
+    auto fd = ::open(path, O_RDONLY);
+    auto done = pread(fd, &word, sizeof(word), offset) == sizeof(word);
+    ::close(fd);
+    return done;
+  }
+
+  // a file with a foreign magic is refused, and left alone
+  bool verifyHeader(const char *path) {
+    uint32_t magic;
+    auto refused = peek(path, 0, magic) && patch(path, 0, ~magic) &&
+                   isRefused(path) && patch(path, 0, magic);
+    return refused && Tree{path}.isOpen();
+  }
+
+  /*
+   * a process dying between two syncs leaves the file dirty, the next
+   * open relinks it with all the updates that process made
+   */
+  bool verifyCrash(const char *path) {
+    multiset<int> expected;
+    if (truncate(path, 0) != 0)
+      return false;
+    {
+      // small, relinking checks the whole tree on every insert
+      Tree tree{path, 16};
+      for (int key = 0; key < 1000; key += 2) {
+        tree.emplace(key, -key);
+        expected.insert(key);
+      }
+    }
+
+    auto update = [&](Tree *tree) {
+      mt19937 rng(20240620);
+      for (int i = 0; i < 600; i++) {
+        int key = rng() % 1000;
+        auto it = expected.lower_bound(key);
+        if (i % 3 == 0 && it != expected.end()) {
+          if (tree != nullptr)
+            tree->erase(tree->search(*it));
+          expected.erase(it);
+        } else {
+          if (tree != nullptr)
+            tree->emplace(key, -key);
+          expected.insert(key);
+        }
+      }
+    };
+
+    auto child = fork();
+    if (child == 0) {
+      Tree tree{path};
+      update(&tree);
+      _exit(tree.isOpen() ? 0 : 1);
+    }
+    update(nullptr);
+
+    int status;
+    uint32_t dirty;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0 || !peek(path, 20, dirty) || dirty != 1)
+      return false;
+
+    Tree tree{path};
+    return tree.isOpen() && matches(tree, expected) && peek(path, 20, dirty) &&
+           dirty == 0;
+  }
+
+  // one tree per Tag at a time, the next one opens once it is closed
+  bool verifyArena(const char *path) {
+    auto second = false;
+    {
+      Tree tree{path};
+      second = isRefused(path);
+      if (!tree.isOpen() || !tree.verifyTree())
+        return false;
+    }
+    return second && Tree{path}.isOpen();
+  }
+
+  // a refused tree is empty and takes no updates, rather than crashing
+  static bool isRefused(const char *path) {
+    Tree tree{path};
+    return !tree.isOpen() && tree.size() == 0 && tree.capacity() == 0 &&
+           tree.generation() == 0 && tree.emplace(Entry{1, -1}) == nullptr &&
+           !tree.reserve(16) && !tree.sync() && !tree.contains(1);
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbMappedTree)
+#endif
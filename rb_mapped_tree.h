@@ -0,0 +1,299 @@
+#ifndef __RB_MAPPED_TREE_H__
+#define __RB_MAPPED_TREE_H__
+
+#include "rb_tree.h"
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+ * Tree living in a memory mapped file, so it survives restarts and opens
+ * in O(1) whatever its size, pages coming in as lookups touch them.
+ *
+ * Nodes use RbIndexLayout: links are 32-bit slots relative to the start
+ * of the node array rather than pointers, which makes the file valid
+ * wherever it gets mapped, and the mapping free to move when the file
+ * grows. The arena base is static per `Tag`, so one tree per `Tag` may
+ * be open at a time: open() refuses another while it is, rather than
+ * repoint the links of the first into the other file.
+ *
+ *   | header, 64 bytes | node slot 0 | node slot 1 | ...
+ *
+ * The header checks that the file holds this very node type and version,
+ * and keeps the root, counts and free list. Updates mark it dirty until
+ * the next sync(), which flushes with msync. A file left dirty, by a
+ * crash between two syncs, may be half linked: open() relinks every slot
+ * in use then, O(n log n), each update since the last sync coming back
+ * either done or undone.
+ *
+ * A tree whose file could not be opened, or was refused, is empty and
+ * stays so: isOpen() tells, sizes read 0, emplace() returns nullptr and
+ * the other updates fail or do nothing.
+ *
+ * Values are constructed in place by emplace() and must be trivially
+ * copyable. Growing the file may move the mapping, any Value pointer
+ * held across an emplace() is stale then; reserve() grows up front.
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity,
+          class Tag = T>
+class RbMappedTree
+    : private RbTree<T, Key, Compare, KeyOf,
+                     RbBaseHook<T, RbNoAugment,
+                                RbIndexLayout<RbIndexArena<Tag>>>> {
+public:
+  using Arena = RbIndexArena<Tag>;
+  using Tree = RbTree<T, Key, Compare, KeyOf,
+                      RbBaseHook<T, RbNoAugment, RbIndexLayout<Arena>>>;
+  using Value = typename Tree::Value;
+
+  static constexpr uint32_t Version = 1;
+
+  static_assert(is_trivially_copyable_v<Value>,
+                "mapped values must be plain bytes");
+
+  RbMappedTree(const char *path, size_t capacity = 1024,
+               Compare compare = Compare{}, KeyOf keyOf = KeyOf{})
+      : Tree{nullptr, compare, keyOf} {
+    open(path, max<size_t>(capacity, 1));
+  }
+  RbMappedTree(const RbMappedTree &) = delete;
+  RbMappedTree &operator=(const RbMappedTree &) = delete;
+  ~RbMappedTree() { close(); }
+
+  bool isOpen() const { return map_ != nullptr; }
+  size_t size() const { return isOpen() ? header()->size : 0; }
+  size_t capacity() const { return isOpen() ? header()->capacity : 0; }
+  uint64_t generation() const { return isOpen() ? header()->generation : 0; }
+
+  // construct a value in a free slot and link it, nullptr if full
+  template <class... Args> Value *emplace(Args &&...args) {
+    auto slot = isOpen() ? takeSlot() : NoSlot;
+    if (slot == NoSlot)
+      return nullptr;
+
+    auto value = new (nodeAt(slot)) Value(forward<Args>(args)...);
+    Tree::insertNode(value);
+    header()->size++;
+    return value;
+  }
+
+  void erase(Value *value) {
+    if (!isOpen())
+      return;
+    markDirty();
+    Tree::deleteNode(value);
+    header()->size--;
+
+    // its own child both ways, as no linked node is, marks the slot free
+    value->linkNodeChild(value, LeftChild);
+    value->linkNodeChild(value, RightChild);
+
+    auto next = header()->freeHead;
+    memcpy(static_cast<void *>(value), &next, sizeof(next));
+    header()->freeHead = Arena::template slotOf<Value>(value);
+  }
+
+  // room for `capacity` nodes, false if the file could not grow
+  bool reserve(size_t capacity) {
+    if (!isOpen())
+      return false;
+    capacity = min<size_t>(capacity, NoSlot);
+    if (capacity <= header()->capacity)
+      return true;
+
+    auto root = rootSlot();
+    auto bytes = NodesOffset + capacity * sizeof(Value);
+    if (ftruncate(fd_, bytes) != 0)
+      return false;
+    auto map = mremap(map_, bytes_, bytes, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED)
+      return false;
+
+    map_ = static_cast<char *>(map);
+    bytes_ = bytes;
+    header()->capacity = capacity;
+    attach(root);
+    return true;
+  }
+
+  // store the root, clear the dirty mark and flush everything to disk
+  bool sync() {
+    if (!isOpen())
+      return false;
+    header()->root = rootSlot();
+    header()->generation++;
+    header()->dirty = 0;
+    return msync(map_, bytes_, MS_SYNC) == 0;
+  }
+
+  using Tree::contains;
+  using Tree::forEachInorder;
+  using Tree::lowerBound;
+  using Tree::search;
+  using Tree::upperBound;
+  using Tree::verifyTree;
+
+private:
+  static constexpr uint32_t NoSlot = UINT32_MAX >> 1;
+  static constexpr size_t NodesOffset = 64;
+  static constexpr char Magic[8] = {'R', 'B', 'T', 'R', 'E', 'E', 'M', 'F'};
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint32_t nodeAlign;
+    uint32_t dirty;
+    uint64_t generation;
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t size;
+    uint32_t root;
+    uint32_t freeHead;
+  };
+  static_assert(sizeof(Header) <= NodesOffset);
+  static_assert(alignof(Value) <= NodesOffset);
+
+  Header *header() const { return reinterpret_cast<Header *>(map_); }
+  Value *nodeAt(uint32_t slot) const {
+    return Arena::template nodeAt<Value>(slot);
+  }
+
+  uint32_t rootSlot() const {
+    auto root = Tree::getRootNode();
+    return root != nullptr ? Arena::template slotOf<Value>(root) : NoSlot;
+  }
+
+  // point the arena at the current mapping and pick the root up again
+  void attach(uint32_t root) {
+    Arena::base = map_ + NodesOffset;
+    Tree::setRootNode(root != NoSlot ? nodeAt(root) : nullptr);
+  }
+
+  void open(const char *path, size_t capacity) {
+    struct stat status;
+    if (Arena::base != nullptr)
+      return;
+
+    fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0 || fstat(fd_, &status) != 0) {
+      close();
+      return;
+    }
+
+    auto fresh = status.st_size == 0;
+    bytes_ = fresh ? NodesOffset + capacity * sizeof(Value) : status.st_size;
+    if ((fresh && ftruncate(fd_, bytes_) != 0) || bytes_ < NodesOffset) {
+      close();
+      return;
+    }
+    auto map =
+        mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+      close();
+      return;
+    }
+    map_ = static_cast<char *>(map);
+
+    if (fresh) {
+      *header() = Header{{}, Version, sizeof(Value), alignof(Value), 0, 0,
+                         capacity, 0, 0, NoSlot, NoSlot};
+      memcpy(header()->magic, Magic, sizeof(Magic));
+    } else if (!isValid()) {
+      // not ours, leave it as it is
+      munmap(map_, bytes_);
+      map_ = nullptr;
+      close();
+      return;
+    }
+
+    auto dirty = header()->dirty != 0;
+    attach(dirty ? NoSlot : header()->root);
+    if (dirty)
+      relink();
+  }
+
+  bool isValid() const {
+    auto &h = *header();
+    return memcmp(h.magic, Magic, sizeof(Magic)) == 0 &&
+           h.version == Version && h.nodeSize == sizeof(Value) &&
+           h.nodeAlign == alignof(Value) && h.capacity <= NoSlot &&
+           h.used <= h.capacity &&
+           NodesOffset + h.capacity * h.nodeSize <= bytes_ &&
+           (h.dirty ||
+            (h.size <= h.used && (h.root == NoSlot || h.root < h.used) &&
+             (h.freeHead == NoSlot || h.freeHead < h.used)));
+  }
+
+  /*
+   * Link the slots in use afresh, and rebuild the free list and counts,
+   * as a dirty file may hold any of them half updated. A slot is free if
+   * erase() marked it, or if it is still all zeros as the file grew: both
+   * children then are one and the same node, which no linked node has.
+   */
+  void relink() {
+    auto &h = *header();
+    h.size = 0;
+    h.freeHead = NoSlot;
+
+    for (auto slot = static_cast<uint32_t>(h.used); slot-- > 0;) {
+      auto value = nodeAt(slot);
+      auto left = value->getNodeChild(LeftChild);
+      if (left != nullptr && left == value->getNodeChild(RightChild)) {
+        memcpy(static_cast<void *>(value), &h.freeHead, sizeof(h.freeHead));
+        h.freeHead = slot;
+      } else {
+        Tree::insertNode(value);
+        h.size++;
+      }
+    }
+    sync();
+  }
+
+  void close() {
+    if (map_ != nullptr) {
+      if (header()->dirty)
+        sync();
+      munmap(map_, bytes_);
+      map_ = nullptr;
+      Arena::base = nullptr;
+    }
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+  }
+
+  // the first update after a sync marks the file, and makes it to disk
+  void markDirty() {
+    if (header()->dirty)
+      return;
+    header()->dirty = 1;
+    msync(map_, NodesOffset, MS_SYNC);
+  }
+
+  uint32_t takeSlot() {
+    markDirty();
+    auto &h = *header();
+    if (h.freeHead != NoSlot) {
+      auto slot = h.freeHead;
+      memcpy(&h.freeHead, static_cast<void *>(nodeAt(slot)), sizeof(slot));
+      return slot;
+    }
+    if (h.used == h.capacity &&
+        (h.capacity == NoSlot || !reserve(2 * h.capacity)))
+      return NoSlot;
+    return header()->used++;
+  }
+
+  int fd_ = -1;
+  char *map_ = nullptr;
+  size_t bytes_ = 0;
+};
+#endif
@@ -0,0 +1,158 @@
+#include "rb_persistent_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Entry {
+  Entry(int key, int value) : key{key}, value{value} {}
+  Entry(const Entry &other) : key{other.key}, value{other.value} {
+    copies++;
+  }
+
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+  int value;
+
+  static inline atomic<size_t> copies{0};
+};
+
+using Tree = RbPersistentTree<Entry, int>;
+
+class TestcaseRbPersistentTree : public TestcaseBase {
+public:
+  static constexpr int KeySpace = 4096;
+
+  virtual void testRoutine() override {
+    verifyVersions();
+    verifyPathCopy();
+    verifySharedReaders();
+  }
+
+  static bool matches(const Tree &tree, const map<int, int> &expected) {
+    auto it = expected.begin();
+    auto same = tree.forEachInorder([&](const Entry &entry) {
+      auto match = it != expected.end() && it->first == entry.key &&
+                   it->second == entry.value;
+      ++it;
+      return match;
+    });
+    return same && it == expected.end() && tree.size() == expected.size() &&
+           tree.verifyTree();
+  }
+
+  // every snapshot taken along the way still reads as it was taken
+  void verifyVersions() {
+    mt19937 rng(20240617);
+    vector<pair<Tree, map<int, int>>> versions;
+    Tree tree;
+    map<int, int> expected;
+    auto ok = true;
+
+    for (int op = 0; op < 50000; op++) {
+      int key = rng() % KeySpace;
+      if (rng() % 3 != 0) {
+        int value = rng();
+        tree = tree.insert({key, value});
+        expected[key] = value;
+      } else {
+        tree = tree.erase(key);
+        expected.erase(key);
+      }
+
+      auto found = tree.search(key);
+      ok = ok && (found != nullptr) == expected.contains(key);
+      if (op % 1000 == 0)
+        versions.emplace_back(tree, expected);
+    }
+    for (auto &[version, contents] : versions) {
+      ok = ok && matches(version, contents);
+    }
+
+    if (ok && matches(tree, expected)) {
+      std::cout << "persistent versions verified!" << endl;
+    } else {
+      std::cout << "persistent versions failed" << endl;
+    }
+  }
+
+  // an update copies a path, not the tree
+  void verifyPathCopy() {
+    Tree tree;
+    for (int key = 0; key < KeySpace; key++) {
+      tree = tree.insert({key, key});
+    }
+
+    size_t worst = 0;
+    for (int key = 0; key < KeySpace; key += 7) {
+      auto before = Entry::copies.load();
+      auto updated = key % 2 ? tree.insert({key, -key}) : tree.erase(key);
+      worst = max(worst, Entry::copies - before);
+    }
+
+    // erasing a key not there copies nothing
+    auto before = Entry::copies.load();
+    auto same = tree.erase(KeySpace);
+    auto untouched = Entry::copies == before && same.size() == tree.size();
+
+    // 2 log2(n) levels at most, a handful of nodes rebuilt on each
+    if (worst <= 4 * 2 * 12 && untouched) {
+      std::cout << "persistent path copy verified!" << endl;
+    } else {
+      std::cout << "persistent path copy failed" << endl;
+    }
+  }
+
+  // readers walk their snapshot while the writer derives new versions
+  void verifySharedReaders() {
+    Tree tree;
+    for (int key = 0; key < KeySpace; key += 2) {
+      tree = tree.insert({key, key});
+    }
+
+    atomic<bool> failed{false};
+    vector<thread> readers;
+    for (int i = 0; i < 2; i++) {
+      readers.emplace_back([&failed, snapshot = tree] {
+        for (int pass = 0; pass < 20; pass++) {
+          size_t count = 0;
+          snapshot.forEachInorder([&](const Entry &entry) {
+            failed = failed || entry.key % 2 != 0 || entry.value != entry.key;
+            count++;
+          });
+          failed = failed || count != KeySpace / 2;
+        }
+      });
+    }
+
+    mt19937 rng(20240618);
+    for (int op = 0; op < 20000; op++) {
+      int key = rng() % KeySpace;
+      tree = rng() % 2 ? tree.insert({key, -1}) : tree.erase(key);
+    }
+    for (auto &reader : readers) {
+      reader.join();
+    }
+
+    if (!failed && tree.verifyTree()) {
+      std::cout << "persistent shared readers verified!" << endl;
+    } else {
+      std::cout << "persistent shared readers failed" << endl;
+    }
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbPersistentTree)
+#endif
@@ -0,0 +1,325 @@
+#ifndef __RB_PERSISTENT_TREE_H__
+#define __RB_PERSISTENT_TREE_H__
+
+#include "rb_tree.h"
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+using namespace std;
+
+/*
+ * Persistent red-black tree: nodes are immutable once built, an update
+ * copies the O(log n) nodes on its path (plus O(1) per level for the
+ * rebalancing) and returns a new version sharing everything else with
+ * the old one. Copying a tree is O(1), that is a snapshot, and every
+ * version stays readable as long as some copy of it is alive, from any
+ * thread, while others keep deriving new versions: nodes are reference
+ * counted atomically and freed with the last version using them.
+ *
+ * Keys are unique, insert() of a key already there replaces the payload.
+ * A tree object itself is a plain value, publishing a new version to
+ * other threads takes the usual synchronization on that object.
+ * Rebalancing follows Kahrs' functional insertion and deletion.
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity>
+class RbPersistentTree {
+  struct Node;
+
+  // counted reference to an immutable node
+  class Ref {
+  public:
+    Ref() = default;
+    explicit Ref(const Node *node) : node_{node} {
+      if (node_ != nullptr)
+        node_->refs.fetch_add(1, memory_order_relaxed);
+    }
+    Ref(const Ref &other) : Ref{other.node_} {}
+    Ref(Ref &&other) : node_{exchange(other.node_, nullptr)} {}
+    Ref &operator=(Ref other) {
+      swap(node_, other.node_);
+      return *this;
+    }
+    ~Ref() {
+      if (node_ != nullptr &&
+          node_->refs.fetch_sub(1, memory_order_acq_rel) == 1)
+        delete node_;
+    }
+
+    const Node *operator->() const { return node_; }
+    const Node *get() const { return node_; }
+    explicit operator bool() const { return node_ != nullptr; }
+
+  private:
+    const Node *node_ = nullptr;
+  };
+
+  struct Node {
+    mutable atomic<size_t> refs{0};
+    RbNodeColor color;
+    Ref left, right;
+    T payload;
+  };
+
+public:
+  RbPersistentTree(Compare compare = Compare{}, KeyOf keyOf = KeyOf{})
+      : compare_{compare}, keyOf_{keyOf} {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // a new version holding `value` too, this one is left alone
+  [[nodiscard]] RbPersistentTree insert(const T &value) const {
+    auto tree = *this;
+    auto grown = false;
+    tree.root_ = blacken(tree.ins(root_, value, grown));
+    tree.size_ += grown;
+    return tree;
+  }
+
+  // a new version without `key`, this one is left alone
+  [[nodiscard]] RbPersistentTree erase(const Key &key) const {
+    auto found = false;
+    auto root = del(root_, key, found);
+    if (!found)
+      return *this;
+
+    auto tree = *this;
+    tree.root_ = blacken(root);
+    tree.size_--;
+    return tree;
+  }
+
+  // the payload with `key`, valid as long as this version is alive
+  const T *search(const Key &key) const {
+    auto bound = lowerBound(key);
+    return bound != nullptr && !compare_(key, keyOf_(*bound)) ? bound
+                                                              : nullptr;
+  }
+
+  bool contains(const Key &key) const { return search(key) != nullptr; }
+
+  // first payload not less than key, nullptr if none
+  const T *lowerBound(const Key &key) const {
+    return partitionPoint(
+        [&](const T &payload) { return compare_(keyOf_(payload), key); });
+  }
+
+  /*
+   * The first payload for which `before(const T &)` is false, nullptr if
+   * none, `before` holding for a prefix of the order: lowerBound() for
+   * keys of another type or order.
+   */
+  template <class F> const T *partitionPoint(F &&before) const {
+    const Node *node = root_.get(), *bound = nullptr;
+
+    while (node != nullptr) {
+      if (before(node->payload)) {
+        node = node->right.get();
+      } else {
+        bound = node;
+        node = node->left.get();
+      }
+    }
+    return bound != nullptr ? &bound->payload : nullptr;
+  }
+
+  // visit(const T &) in order, it may return false to stop
+  template <class F> bool forEachInorder(F &&visit) const {
+    const Node *stack[MaxHeight];
+    auto top = 0;
+    auto node = root_.get();
+
+    while (node != nullptr || top > 0) {
+      for (; node != nullptr; node = node->left.get()) {
+        stack[top++] = node;
+      }
+      node = stack[--top];
+      if constexpr (is_void_v<invoke_result_t<F &, const T &>>) {
+        visit(node->payload);
+      } else if (!visit(node->payload)) {
+        return false;
+      }
+      node = node->right.get();
+    }
+    return true;
+  }
+
+  bool verifyTree() const {
+    const T *previous = nullptr;
+    auto ordered = forEachInorder([&](const T &payload) {
+      auto inOrder =
+          previous == nullptr || compare_(keyOf_(*previous), keyOf_(payload));
+      previous = &payload;
+      return inOrder;
+    });
+    return ordered && !isRed(root_) && blackHeight(root_) >= 0;
+  }
+
+private:
+  static constexpr int MaxHeight = 2 * 64;
+
+  static Ref make(RbNodeColor color, Ref left, const T &payload, Ref right) {
+    return Ref{new Node{{}, color, move(left), move(right), payload}};
+  }
+
+  static bool isRed(const Ref &node) { return node && node->color == Red; }
+  static bool isBlack(const Ref &node) { return node && node->color == Black; }
+
+  static Ref blacken(Ref node) {
+    return isRed(node) ? make(Black, node->left, node->payload, node->right)
+                       : node;
+  }
+
+  // black height of the subtree, -1 if it breaks a red-black property
+  static int blackHeight(const Ref &node) {
+    if (!node)
+      return 0;
+    if (isRed(node) && (isRed(node->left) || isRed(node->right)))
+      return -1;
+
+    auto left = blackHeight(node->left);
+    if (left < 0 || left != blackHeight(node->right))
+      return -1;
+    return left + (node->color == Black);
+  }
+
+  // a black node over `a`, `y` and `b` with a red-red pair below it
+  static Ref balance(const Ref &a, const T &y, const Ref &b) {
+    if (isRed(a) && isRed(b))
+      return make(Red, make(Black, a->left, a->payload, a->right), y,
+                  make(Black, b->left, b->payload, b->right));
+    if (isRed(a) && isRed(a->left))
+      return make(Red,
+                  make(Black, a->left->left, a->left->payload,
+                       a->left->right),
+                  a->payload, make(Black, a->right, y, b));
+    if (isRed(a) && isRed(a->right))
+      return make(Red, make(Black, a->left, a->payload, a->right->left),
+                  a->right->payload, make(Black, a->right->right, y, b));
+    if (isRed(b) && isRed(b->right))
+      return make(Red, make(Black, a, y, b->left), b->payload,
+                  make(Black, b->right->left, b->right->payload,
+                       b->right->right));
+    if (isRed(b) && isRed(b->left))
+      return make(Red, make(Black, a, y, b->left->left), b->left->payload,
+                  make(Black, b->left->right, b->payload, b->right));
+    return make(Black, a, y, b);
+  }
+
+  Ref ins(const Ref &node, const T &value, bool &grown) const {
+    if (!node) {
+      grown = true;
+      return make(Red, {}, value, {});
+    }
+
+    const auto &key = keyOf_(value);
+    if (compare_(key, keyOf_(node->payload))) {
+      auto left = ins(node->left, value, grown);
+      return node->color == Black
+                 ? balance(left, node->payload, node->right)
+                 : make(Red, left, node->payload, node->right);
+    }
+    if (compare_(keyOf_(node->payload), key)) {
+      auto right = ins(node->right, value, grown);
+      return node->color == Black
+                 ? balance(node->left, node->payload, right)
+                 : make(Red, node->left, node->payload, right);
+    }
+    return make(node->color, node->left, value, node->right);
+  }
+
+  // a black node turned red, one black level less
+  static Ref redden(const Ref &node) {
+    return make(Red, node->left, node->payload, node->right);
+  }
+
+  // the left side lost a black level
+  static Ref balanceLeft(const Ref &left, const T &y, const Ref &right) {
+    if (isRed(left))
+      return make(Red, make(Black, left->left, left->payload, left->right), y,
+                  right);
+    if (isBlack(right))
+      return balance(left, y, redden(right));
+
+    // right is red over a black left child
+    auto &inner = right->left;
+    return make(Red, make(Black, left, y, inner->left), inner->payload,
+                balance(inner->right, right->payload, redden(right->right)));
+  }
+
+  // the right side lost a black level
+  static Ref balanceRight(const Ref &left, const T &y, const Ref &right) {
+    if (isRed(right))
+      return make(Red, left, y,
+                  make(Black, right->left, right->payload, right->right));
+    if (isBlack(left))
+      return balance(redden(left), y, right);
+
+    // left is red over a black right child
+    auto &inner = left->right;
+    return make(Red, balance(redden(left->left), left->payload, inner->left),
+                inner->payload, make(Black, inner->right, y, right));
+  }
+
+  // the two subtrees of a removed node fused into one
+  static Ref fuse(const Ref &a, const Ref &b) {
+    if (!a)
+      return b;
+    if (!b)
+      return a;
+
+    if (isRed(a) && isRed(b)) {
+      auto middle = fuse(a->right, b->left);
+      if (isRed(middle))
+        return make(Red, make(Red, a->left, a->payload, middle->left),
+                    middle->payload,
+                    make(Red, middle->right, b->payload, b->right));
+      return make(Red, a->left, a->payload,
+                  make(Red, middle, b->payload, b->right));
+    }
+    if (isBlack(a) && isBlack(b)) {
+      auto middle = fuse(a->right, b->left);
+      if (isRed(middle))
+        return make(Red, make(Black, a->left, a->payload, middle->left),
+                    middle->payload,
+                    make(Black, middle->right, b->payload, b->right));
+      return balanceLeft(a->left, a->payload,
+                         make(Black, middle, b->payload, b->right));
+    }
+    if (isRed(b))
+      return make(Red, fuse(a, b->left), b->payload, b->right);
+    return make(Red, a->left, a->payload, fuse(a->right, b));
+  }
+
+  // `found` tells whether `key` was there, the path is copied only then
+  Ref del(const Ref &node, const Key &key, bool &found) const {
+    if (!node)
+      return {};
+
+    if (compare_(key, keyOf_(node->payload))) {
+      auto left = del(node->left, key, found);
+      if (!found)
+        return node;
+      return isBlack(node->left)
+                 ? balanceLeft(left, node->payload, node->right)
+                 : make(Red, left, node->payload, node->right);
+    }
+    if (compare_(keyOf_(node->payload), key)) {
+      auto right = del(node->right, key, found);
+      if (!found)
+        return node;
+      return isBlack(node->right)
+                 ? balanceRight(node->left, node->payload, right)
+                 : make(Red, node->left, node->payload, right);
+    }
+    found = true;
+    return fuse(node->left, node->right);
+  }
+
+  Ref root_;
+  size_t size_ = 0;
+  [[no_unique_address]] Compare compare_;
+  [[no_unique_address]] KeyOf keyOf_;
+};
+#endif
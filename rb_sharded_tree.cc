@@ -0,0 +1,141 @@
+#include "rb_sharded_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Entry {
+  int get() const { return key; }
+
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+};
+
+using EntryNode = RbNode<Entry>;
+
+/*
+ * Every writer toggles its own slice of nodes in and out with random
+ * keys, 50/50 inserts and deletes once warmed up.
+ */
+class TestcaseRbShardedTree : public TestcaseBase {
+public:
+  static constexpr int KeySpace = 1 << 20;
+  static constexpr int Shards = 64;
+  static constexpr int NodesPerWriter = 2000;
+
+  struct Workload {
+    RbShardedTree<Entry, int> tree{splits()};
+    vector<EntryNode> nodes;
+    vector<char> linked;
+    atomic<bool> stop{false};
+    atomic<size_t> ops{0};
+
+    explicit Workload(unsigned writers)
+        : nodes(writers * NodesPerWriter), linked(nodes.size()) {}
+
+    static vector<int> splits() {
+      vector<int> splits;
+      for (int i = 1; i < Shards; i++) {
+        splits.push_back(i * (KeySpace / Shards));
+      }
+      return splits;
+    }
+
+    // `count` operations, or until stopped if 0
+    void write(unsigned writer, size_t count) {
+      mt19937 rng(writer);
+      auto first = writer * NodesPerWriter;
+      size_t done = 0;
+
+      for (; done < count || (count == 0 && !stop); done++) {
+        auto i = first + rng() % NodesPerWriter;
+        if (linked[i]) {
+          tree.deleteNode(&nodes[i]);
+        } else {
+          nodes[i].key = rng() % KeySpace;
+          tree.insertNode(&nodes[i]);
+        }
+        linked[i] = !linked[i];
+      }
+      ops += done;
+    }
+  };
+
+  virtual void testRoutine() override {
+    verifyWriters();
+    scaleWriters();
+  }
+
+  void verifyWriters() {
+    auto count = max(2u, thread::hardware_concurrency());
+    Workload workload{count};
+    vector<thread> writers;
+
+    for (unsigned i = 0; i < count; i++) {
+      writers.emplace_back([&, i] { workload.write(i, 20000); });
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+
+    size_t expected = 0, visited = 0;
+    auto previous = -1;
+    auto ordered = workload.tree.forEachInorder([&](EntryNode *node) {
+      auto inOrder = previous <= node->key;
+      previous = node->key;
+      visited++;
+      return inOrder;
+    });
+    for (size_t i = 0; i < workload.nodes.size(); i++) {
+      expected += workload.linked[i];
+      if (workload.linked[i] &&
+          workload.tree.search(workload.nodes[i].key) == nullptr)
+        ordered = false;
+    }
+
+    if (ordered && visited == expected && workload.tree.verifyTree()) {
+      std::cout << "sharded writers verified!" << endl;
+    } else {
+      std::cout << "sharded writers failed" << endl;
+    }
+  }
+
+  // mixed insert/delete operations per second, 1 writer up to all cores
+  void scaleWriters() {
+    auto cores = max(1u, thread::hardware_concurrency());
+
+    for (unsigned count = 1;; count = min(2 * count, cores)) {
+      Workload workload{count};
+      vector<thread> writers;
+
+      for (unsigned i = 0; i < count; i++) {
+        writers.emplace_back([&, i] { workload.write(i, 0); });
+      }
+      this_thread::sleep_for(chrono::milliseconds(100));
+      workload.stop = true;
+      for (auto &writer : writers) {
+        writer.join();
+      }
+
+      std::cout << "sharded writers: " << count << " threads, "
+                << workload.ops * 10 << " ops/s" << endl;
+      if (count == cores)
+        break;
+    }
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbShardedTree)
+#endif
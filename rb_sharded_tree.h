@@ -0,0 +1,136 @@
+#ifndef __RB_SHARDED_TREE_H__
+#define __RB_SHARDED_TREE_H__
+
+#include "rb_tree.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <span>
+
+using namespace std;
+
+/*
+ * Multi-writer tree: the key space is cut into ranges by sorted split
+ * keys, each range is an RbTree of its own behind its own lock. Routing a
+ * key is a lock-free binary search over the splits, which never change,
+ * so writers on different ranges never meet and throughput grows with
+ * cores as long as the splits spread the keys.
+ *
+ * Shard i holds the keys in [splits[i - 1], splits[i]), order across
+ * shards is the key order, so in-order walks go shard after shard.
+ * Values returned by lookups may be deleted by another thread as soon
+ * as the shard lock is dropped, freeing them is up to the caller.
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity,
+          class Hook = RbBaseHook<T>>
+class RbShardedTree {
+public:
+  using Tree = RbTree<T, Key, Compare, KeyOf, Hook>;
+  using Value = typename Tree::Value;
+
+  RbShardedTree(span<const Key> splits, Compare compare = Compare{},
+                KeyOf keyOf = KeyOf{})
+      : splits_{splits.begin(), splits.end()},
+        shards_{make_unique<Shard[]>(splits.size() + 1)}, compare_{compare},
+        keyOf_{keyOf} {
+    for (size_t i = 0; i <= splits.size(); i++) {
+      shards_[i].tree = Tree{nullptr, compare, keyOf};
+    }
+  }
+
+  size_t shards() const { return splits_.size() + 1; }
+
+  RbShardedTree &insertNode(Value *value) {
+    auto &shard = shardOf(keyOf_(static_cast<const T &>(*value)));
+    lock_guard lock{shard.lock};
+    shard.tree.insertNode(value);
+    return *this;
+  }
+
+  RbShardedTree &deleteNode(Value *value) {
+    auto &shard = shardOf(keyOf_(static_cast<const T &>(*value)));
+    lock_guard lock{shard.lock};
+    shard.tree.deleteNode(value);
+    return *this;
+  }
+
+  Value *search(const Key &key) {
+    auto &shard = shardOf(key);
+    lock_guard lock{shard.lock};
+    return shard.tree.search(key);
+  }
+
+  bool contains(const Key &key) { return search(key) != nullptr; }
+
+  // first value not less than key, looking into later shards if need be
+  Value *lowerBound(const Key &key) {
+    for (auto i = indexOf(key); i < shards(); i++) {
+      lock_guard lock{shards_[i].lock};
+      if (auto value = shards_[i].tree.lowerBound(key))
+        return value;
+    }
+    return nullptr;
+  }
+
+  /*
+   * Run `f(tree)` on the shard of `key` under its lock, for compound
+   * operations which must not interleave with other writers.
+   */
+  template <class F> decltype(auto) withShard(const Key &key, F &&f) {
+    auto &shard = shardOf(key);
+    lock_guard lock{shard.lock};
+    return f(shard.tree);
+  }
+
+  /*
+   * Visit every value in order, each shard under its own lock in turn,
+   * so the walk is consistent per shard only. The visitor may return
+   * false to stop.
+   */
+  template <class F> bool forEachInorder(F &&visit) {
+    for (size_t i = 0; i < shards(); i++) {
+      lock_guard lock{shards_[i].lock};
+      if (!shards_[i].tree.forEachInorder(visit))
+        return false;
+    }
+    return true;
+  }
+
+  // every shard is a valid tree and keeps to its range
+  bool verifyTree() {
+    for (size_t i = 0; i < shards(); i++) {
+      lock_guard lock{shards_[i].lock};
+      auto inRange = shards_[i].tree.forEachInorder([&](Value *value) {
+        return indexOf(keyOf_(static_cast<const T &>(*value))) == i;
+      });
+      if (!inRange || !shards_[i].tree.verifyTree())
+        return false;
+    }
+    return true;
+  }
+
+private:
+  // a line of its own, so shard locks do not share cache lines
+  struct alignas(64) Shard {
+    mutex lock;
+    Tree tree;
+  };
+
+  template <class K> size_t indexOf(const K &key) {
+    return upper_bound(splits_.begin(), splits_.end(), key,
+                       [&](const K &key, const Key &split) {
+                         return compare_(key, split);
+                       }) -
+           splits_.begin();
+  }
+
+  template <class K> Shard &shardOf(const K &key) {
+    return shards_[indexOf(key)];
+  }
+
+  vector<Key> splits_;
+  unique_ptr<Shard[]> shards_;
+  [[no_unique_address]] Compare compare_;
+  [[no_unique_address]] KeyOf keyOf_;
+};
+#endif
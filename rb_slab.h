@@ -0,0 +1,114 @@
+#ifndef __RB_SLAB_H__
+#define __RB_SLAB_H__
+
+#include <algorithm>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+/*
+ * Pool of same-sized objects: slots are carved out of slabs which double
+ * in size up to MaxSlots, a destroyed slot goes onto an intrusive LIFO
+ * free list and is reused before any fresh one. Slabs come from a
+ * memory_resource (new/delete by default), so n objects cost O(log n)
+ * upstream calls and objects created together sit together in memory.
+ */
+template <class T> class RbSlab {
+public:
+  explicit RbSlab(pmr::memory_resource *upstream = pmr::get_default_resource())
+      : upstream_{upstream} {}
+  RbSlab(const RbSlab &) = delete;
+  RbSlab &operator=(const RbSlab &) = delete;
+  RbSlab(RbSlab &&other) : upstream_{other.upstream_} { swap(*this, other); }
+  ~RbSlab() { release(); }
+
+  template <class... Args> T *create(Args &&...args) {
+    return new (allocate()->storage) T(forward<Args>(args)...);
+  }
+
+  void destroy(T *value) {
+    value->~T();
+    // the storage sits at the start of its slot
+    auto slot = reinterpret_cast<Slot *>(value);
+    slot->next = free_;
+    free_ = slot;
+  }
+
+  /*
+   * Give every slab back upstream at once, objects still alive in them
+   * are not destroyed.
+   */
+  void release() {
+    while (slabs_ != nullptr) {
+      auto next = slabs_->next;
+      upstream_->deallocate(slabs_, bytesOf(slabs_->count), Alignment);
+      slabs_ = next;
+    }
+    free_ = next_ = end_ = nullptr;
+  }
+
+  pmr::memory_resource *resource() const { return upstream_; }
+
+  friend void swap(RbSlab &a, RbSlab &b) {
+    std::swap(a.upstream_, b.upstream_);
+    std::swap(a.slabs_, b.slabs_);
+    std::swap(a.free_, b.free_);
+    std::swap(a.next_, b.next_);
+    std::swap(a.end_, b.end_);
+  }
+
+private:
+  static constexpr size_t MinSlots = 16;
+  static constexpr size_t MaxSlots = 4096;
+
+  union Slot {
+    Slot *next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  // header in front of the slots of every slab
+  struct Slab {
+    Slab *next;
+    size_t count;
+  };
+
+  static constexpr size_t Alignment = max(alignof(Slab), alignof(Slot));
+  static constexpr size_t HeaderSize =
+      (sizeof(Slab) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+
+  static size_t bytesOf(size_t count) {
+    return HeaderSize + count * sizeof(Slot);
+  }
+
+  Slot *allocate() {
+    if (free_ != nullptr)
+      return exchange(free_, free_->next);
+
+    if (next_ == end_)
+      grow();
+    return next_++;
+  }
+
+  void grow() {
+    auto count =
+        slabs_ != nullptr ? min(slabs_->count * 2, MaxSlots) : MinSlots;
+    auto slab =
+        static_cast<Slab *>(upstream_->allocate(bytesOf(count), Alignment));
+
+    *slab = {slabs_, count};
+    slabs_ = slab;
+    next_ = reinterpret_cast<Slot *>(reinterpret_cast<char *>(slab) +
+                                     HeaderSize);
+    end_ = next_ + count;
+  }
+
+  pmr::memory_resource *upstream_;
+  Slab *slabs_ = nullptr;
+  Slot *free_ = nullptr;
+  // never handed out yet: [next_, end_) of the newest slab
+  Slot *next_ = nullptr;
+  Slot *end_ = nullptr;
+};
+#endif
@@ -0,0 +1,214 @@
+#ifndef __RB_STATS_H__
+#define __RB_STATS_H__
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+/*
+ * What RbTree reports to its instrumentation policy. The cases are those
+ * labelled in insertRebalance() and deleteRebalance(), loops count the
+ * turns of their rebalancing loops, comparisons every key comparison.
+ */
+enum RbStatEvent {
+  RbInsertCase1,
+  RbInsertCase2,
+  RbInsertCase3,
+  RbDeleteCase1,
+  RbDeleteCase2,
+  RbDeleteCase3,
+  RbDeleteCase4,
+  RbInsertLoops,
+  RbDeleteLoops,
+  RbComparisons,
+  RbStatEvents,
+};
+
+enum RbStatOp { RbInsertOp, RbDeleteOp, RbStatOps };
+
+/*
+ * Instrumentation policies:
+ *   count(event)          one more `event`
+ *   descent(depth)        a search went `depth` levels down
+ *   latency(op, ns)       an insertNode()/deleteNode() took `ns`
+ * RbNoStats keeps nothing, every call compiles to nothing and the clock
+ * is not even read.
+ */
+struct RbNoStats {
+  static constexpr bool Enabled = false;
+
+  static void count(RbStatEvent, uint64_t = 1) {}
+  static void descent(unsigned) {}
+  static void latency(RbStatOp, uint64_t) {}
+};
+
+/*
+ * Counters per thread, so the hot path never shares a cache line nor
+ * takes a lock: each thread bumps its own, snapshot() adds them all up,
+ * threads gone included. Latencies and descent depths are histograms,
+ * latency bucket i counting operations of [2^(i - 1), 2^i) ns. Trees
+ * sharing a `Tag` share counters.
+ */
+template <class Tag = void> class RbTreeStats {
+public:
+  static constexpr bool Enabled = true;
+  static constexpr unsigned MaxDepth = 128;
+  static constexpr unsigned LatencyBuckets = 64;
+
+  struct Snapshot {
+    uint64_t events[RbStatEvents] = {};
+    uint64_t depths[MaxDepth] = {};
+    uint64_t latencies[RbStatOps][LatencyBuckets] = {};
+
+    uint64_t rotations() const {
+      return events[RbInsertCase2] + events[RbInsertCase3] +
+             events[RbDeleteCase1] + events[RbDeleteCase3] +
+             events[RbDeleteCase4];
+    }
+
+    // smallest bucket bound under which `quantile` of `op` completed
+    uint64_t latencyBound(RbStatOp op, double quantile) const {
+      uint64_t total = 0, seen = 0;
+      for (auto count : latencies[op]) {
+        total += count;
+      }
+      for (unsigned i = 0; i < LatencyBuckets; i++) {
+        seen += latencies[op][i];
+        if (total > 0 && seen >= quantile * total)
+          return uint64_t{1} << i;
+      }
+      return 0;
+    }
+  };
+
+  static void count(RbStatEvent event, uint64_t n = 1) {
+    bump(local().events[event], n);
+  }
+  static void descent(unsigned depth) {
+    bump(local().depths[min(depth, MaxDepth - 1)]);
+  }
+  static void latency(RbStatOp op, uint64_t ns) {
+    bump(local().latencies[op][min<unsigned>(bit_width(ns),
+                                             LatencyBuckets - 1)]);
+  }
+
+  static Snapshot snapshot() {
+    lock_guard lock{registry().lock};
+    auto total = registry().retired;
+    for (auto counters : registry().live) {
+      counters->addTo(total);
+    }
+    return total;
+  }
+
+  // zero every counter, best called while no tree is being updated
+  static void reset() {
+    lock_guard lock{registry().lock};
+    registry().retired = Snapshot{};
+    for (auto counters : registry().live) {
+      counters->clear();
+    }
+  }
+
+private:
+  struct Counters {
+    atomic<uint64_t> events[RbStatEvents] = {};
+    atomic<uint64_t> depths[MaxDepth] = {};
+    atomic<uint64_t> latencies[RbStatOps][LatencyBuckets] = {};
+
+    void addTo(Snapshot &snapshot) const {
+      for (unsigned i = 0; i < RbStatEvents; i++) {
+        snapshot.events[i] += events[i].load(memory_order_relaxed);
+      }
+      for (unsigned i = 0; i < MaxDepth; i++) {
+        snapshot.depths[i] += depths[i].load(memory_order_relaxed);
+      }
+      for (unsigned op = 0; op < RbStatOps; op++) {
+        for (unsigned i = 0; i < LatencyBuckets; i++) {
+          snapshot.latencies[op][i] +=
+              latencies[op][i].load(memory_order_relaxed);
+        }
+      }
+    }
+
+    void clear() {
+      for (auto &count : events) {
+        count.store(0, memory_order_relaxed);
+      }
+      for (auto &count : depths) {
+        count.store(0, memory_order_relaxed);
+      }
+      for (auto &counts : latencies) {
+        for (auto &count : counts) {
+          count.store(0, memory_order_relaxed);
+        }
+      }
+    }
+  };
+
+  struct Registry {
+    mutex lock;
+    vector<Counters *> live;
+    Snapshot retired;
+  };
+
+  // a thread's counters, folded into `retired` when it exits
+  struct Local {
+    Counters counters;
+
+    Local() {
+      lock_guard lock{registry().lock};
+      registry().live.push_back(&counters);
+    }
+    ~Local() {
+      lock_guard lock{registry().lock};
+      auto &live = registry().live;
+      counters.addTo(registry().retired);
+      erase(live, &counters);
+    }
+  };
+
+  static Registry &registry() {
+    static Registry registry;
+    return registry;
+  }
+
+  static Counters &local() {
+    thread_local Local local;
+    return local.counters;
+  }
+
+  // only the owner thread writes, a plain add is enough
+  static void bump(atomic<uint64_t> &count, uint64_t n = 1) {
+    count.store(count.load(memory_order_relaxed) + n, memory_order_relaxed);
+  }
+};
+
+// times a scope into `Stats`, reading the clock only if it is enabled
+template <class Stats> class RbStatTimer {
+public:
+  explicit RbStatTimer(RbStatOp op) : op_{op} {
+    if constexpr (Stats::Enabled)
+      start_ = chrono::steady_clock::now();
+  }
+  ~RbStatTimer() {
+    if constexpr (Stats::Enabled)
+      Stats::latency(op_, chrono::duration_cast<chrono::nanoseconds>(
+                              chrono::steady_clock::now() - start_)
+                              .count());
+  }
+
+private:
+  RbStatOp op_;
+  [[no_unique_address]] conditional_t<Stats::Enabled,
+                                      chrono::steady_clock::time_point,
+                                      bool> start_{};
+};
+#endif
@@ -0,0 +1,275 @@
+#include "rb_bench.h"
+#include "rb_timer_queue.h"
+
+using namespace std;
+
+#ifdef _BENCH_ENABLE
+
+#include "testcase.h"
+#include <queue>
+
+namespace {
+struct Timer {
+  u64 deadline;
+};
+
+struct TimerDeadline {
+  u64 operator()(const Timer &timer) const { return timer.deadline; }
+};
+
+using TimerNode = RbNode<Timer>;
+
+/*
+ * Deadline queues behind one interface, timers being ids 0..n-1:
+ *   schedule(id, deadline)   arm a timer which is not armed
+ *   cancel(id)               disarm a timer which is
+ *   advance(now, fire)       fire(id) every timer due by `now`
+ */
+class TimerQueueSubject {
+public:
+  static constexpr const char *Name = "rb_timer_queue";
+
+  explicit TimerQueueSubject(size_t n) : timers_(n) {}
+
+  void schedule(u32 id, u64 deadline) {
+    timers_[id].deadline = deadline;
+    queue_.push(&timers_[id]);
+  }
+  void cancel(u32 id) { queue_.erase(&timers_[id]); }
+
+  template <class F> void advance(u64 now, F &&fire) {
+    queue_.popExpired(now, [&](TimerNode *timer) {
+      fire(static_cast<u32>(timer - timers_.data()));
+    });
+  }
+
+private:
+  vector<TimerNode> timers_;
+  RbTimerQueue<Timer, u64, less<>, TimerDeadline> queue_;
+};
+
+// what the queue replaces: the minimum found by walking the left spine
+class TreeSubject {
+public:
+  static constexpr const char *Name = "rb_tree";
+
+  explicit TreeSubject(size_t n) : timers_(n) {}
+
+  void schedule(u32 id, u64 deadline) {
+    timers_[id].deadline = deadline;
+    tree_.insertNode(&timers_[id]);
+  }
+  void cancel(u32 id) { tree_.deleteNode(&timers_[id]); }
+
+  template <class F> void advance(u64 now, F &&fire) {
+    for (auto timer = tree_.first(); timer != nullptr && timer->deadline <= now;
+         timer = tree_.first()) {
+      tree_.deleteNode(timer);
+      fire(static_cast<u32>(timer - timers_.data()));
+    }
+  }
+
+private:
+  vector<TimerNode> timers_;
+  RbTree<Timer, u64, less<>, TimerDeadline> tree_;
+};
+
+// binary heap, cancelled entries left in place and skipped once popped
+class HeapSubject {
+public:
+  static constexpr const char *Name = "priority_queue";
+
+  explicit HeapSubject(size_t n) : versions_(n) {}
+
+  void schedule(u32 id, u64 deadline) {
+    heap_.push({deadline, id, ++versions_[id]});
+  }
+  void cancel(u32 id) { ++versions_[id]; }
+
+  template <class F> void advance(u64 now, F &&fire) {
+    while (!heap_.empty() && heap_.top().deadline <= now) {
+      auto entry = heap_.top();
+      heap_.pop();
+      if (entry.version == versions_[entry.id])
+        fire(entry.id);
+    }
+  }
+
+private:
+  struct Entry {
+    u64 deadline;
+    u32 id;
+    u32 version;
+
+    bool operator>(const Entry &other) const {
+      return deadline > other.deadline;
+    }
+  };
+
+  vector<u32> versions_;
+  priority_queue<Entry, vector<Entry>, greater<>> heap_;
+};
+
+/*
+ * Hierarchical timer wheel (Varghese and Lauck): level l has 64 slots of
+ * 64^l ticks each. A timer goes to the lowest level whose span covers
+ * its delay, and cascades one level down whenever the clock reaches the
+ * start of its slot, to be fired from level 0 on its very tick. Arming
+ * and cancelling are O(1); advancing visits every tick on the way.
+ */
+class WheelSubject {
+public:
+  static constexpr const char *Name = "timer_wheel";
+  static constexpr unsigned Bits = 6;
+  static constexpr unsigned Slots = 1u << Bits;
+  static constexpr unsigned Levels = 4;
+
+  explicit WheelSubject(size_t n) : timers_(n) {}
+
+  void schedule(u32 id, u64 deadline) {
+    auto &timer = timers_[id];
+    auto delay = deadline > now_ ? deadline - now_ : 0;
+    unsigned level = 0;
+
+    while (level + 1 < Levels && delay >> Bits * (level + 1) != 0) {
+      level++;
+    }
+    timer.deadline = deadline;
+    timer.level = level;
+    timer.slot = deadline >> Bits * level & (Slots - 1);
+    auto &slot = slots_[timer.level][timer.slot];
+    timer.index = slot.size();
+    slot.push_back(id);
+  }
+
+  void cancel(u32 id) {
+    auto &timer = timers_[id];
+    auto &slot = slots_[timer.level][timer.slot];
+    auto moved = slot.back();
+    slot[timer.index] = moved;
+    timers_[moved].index = timer.index;
+    slot.pop_back();
+  }
+
+  template <class F> void advance(u64 now, F &&fire) {
+    while (now_ < now) {
+      now_++;
+      for (auto level = cascadeFrom(); level > 0; level--) {
+        auto ids = move(slots_[level][now_ >> Bits * level & (Slots - 1)]);
+        for (auto id : ids) {
+          schedule(id, timers_[id].deadline);
+        }
+      }
+      auto ids = move(slots_[0][now_ & (Slots - 1)]);
+      for (auto id : ids) {
+        fire(id);
+      }
+    }
+  }
+
+private:
+  struct Timer {
+    u64 deadline;
+    u32 index;
+    u8 level;
+    u8 slot;
+  };
+
+  // the highest level whose slot starts at this tick
+  unsigned cascadeFrom() const {
+    unsigned level = 0;
+    while (level + 1 < Levels &&
+           (now_ & ((u64{1} << Bits * (level + 1)) - 1)) == 0) {
+      level++;
+    }
+    return level;
+  }
+
+  vector<Timer> timers_;
+  vector<u32> slots_[Levels][Slots];
+  u64 now_ = 0;
+};
+
+/*
+ * n timers over a clock starting at 0, the delays either drawn from
+ * [1, 2n] or all n ticks, as with one fixed timeout:
+ *   schedule  arm the n timers
+ *   rearm     advance a tick at a time, n ticks, every timer fired armed
+ *             again from now
+ *   cancel    n times, disarm a random armed timer and arm it again
+ *   expire    advance until every timer has fired
+ */
+class BenchTimerQueue : public TestcaseBase {
+public:
+  enum Delays { Uniform, Fixed };
+
+  static constexpr const char *DelayNames[] = {"uniform", "fixed"};
+
+  virtual void testRoutine() override {
+    RbBenchReport report;
+    RbPerfCounters counters;
+
+    for (auto n : RbBenchConfig::get().sizes()) {
+      for (auto delays : {Uniform, Fixed}) {
+        run<TimerQueueSubject>(report, counters, delays, n);
+        run<TreeSubject>(report, counters, delays, n);
+        run<HeapSubject>(report, counters, delays, n);
+        run<WheelSubject>(report, counters, delays, n);
+      }
+    }
+  }
+
+  template <class Subject>
+  void run(RbBenchReport &report, RbPerfCounters &counters, Delays delays,
+           size_t n) {
+    mt19937_64 rng{RbBenchConfig::get().seed};
+    auto delay = [&] { return delays == Fixed ? n : 1 + rng() % (2 * n); };
+    Subject subject{n};
+    vector<bool> armed(n);
+    size_t pending = 0;
+    u64 now = 0;
+
+    auto add = [&](const char *workload, RbBenchResult result) {
+      result.structure = Subject::Name;
+      result.workload = workload;
+      result.distribution = DelayNames[delays];
+      result.size = n;
+      report.add(result);
+    };
+    auto arm = [&](u32 id) {
+      subject.schedule(id, now + delay());
+      armed[id] = true;
+      pending++;
+    };
+    auto fired = [&](u32 id) {
+      armed[id] = false;
+      pending--;
+    };
+
+    add("schedule", rbMeasure(counters, n, [&](size_t i) { arm(i); }));
+    add("rearm", rbMeasure(counters, n, [&](size_t) {
+          subject.advance(++now, [&](u32 id) {
+            fired(id);
+            arm(id);
+          });
+        }));
+    add("cancel", rbMeasure(counters, n, [&](size_t) {
+          auto id = static_cast<u32>(rng() % n);
+          if (armed[id]) {
+            subject.cancel(id);
+            fired(id);
+          }
+          arm(id);
+        }));
+
+    auto horizon = now + 2 * n;
+    add("expire", rbMeasure(counters, horizon - now, [&](size_t) {
+          subject.advance(++now, fired);
+        }));
+    if (pending != 0)
+      fprintf(stderr, "%s: %zu timers never fired\n", Subject::Name, pending);
+  }
+};
+} // namespace
+INIT_CASE(BenchTimerQueue)
+#endif
@@ -0,0 +1,113 @@
+#include "rb_timer_queue.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+struct Timer {
+  u64 deadline;
+  u32 id;
+  bool armed;
+};
+
+struct TimerDeadline {
+  u64 operator()(const Timer &timer) const { return timer.deadline; }
+};
+
+using TimerNode = RbNode<Timer>;
+using Queue = RbTimerQueue<Timer, u64, less<>, TimerDeadline>;
+
+class TestcaseRbTimerQueue : public TestcaseBase {
+public:
+  virtual void testRoutine() override {
+    if (verifyExpiry() && verifyPop()) {
+      std::cout << "timer queue verified!" << endl;
+    } else {
+      std::cout << "timer queue failed" << endl;
+    }
+  }
+
+  /*
+   * a clock ticking on, timers armed for fixed and random timeouts,
+   * cancelled at random, half of those firing re-armed from `fire`
+   */
+  bool verifyExpiry() {
+    vector<TimerNode> timers(2000);
+    multiset<u64> expected;
+    Queue queue;
+    mt19937 rng(20240626);
+    auto result = true;
+
+    auto arm = [&](TimerNode &timer, u64 deadline) {
+      timer.deadline = deadline;
+      timer.armed = true;
+      queue.push(&timer);
+      expected.insert(deadline);
+    };
+    for (u32 i = 0; i < timers.size(); i++) {
+      timers[i].id = i;
+      arm(timers[i], 1 + rng() % 500);
+    }
+
+    for (u64 now = 0; now < 3000 && result; now += 1 + rng() % 4) {
+      auto &cancelled = timers[rng() % timers.size()];
+      if (cancelled.armed) {
+        queue.erase(&cancelled);
+        expected.erase(expected.find(cancelled.deadline));
+        cancelled.armed = false;
+      }
+
+      u64 latest = 0;
+      auto fired = queue.popExpired(now, [&](TimerNode *timer) {
+        result = result && timer->armed && timer->deadline <= now &&
+                 timer->deadline >= latest;
+        latest = timer->deadline;
+        timer->armed = false;
+        expected.erase(expected.find(timer->deadline));
+        if (timer->id % 2 == 0)
+          arm(*timer, now + (timer->id % 4 == 0 ? 200 : 1 + rng() % 400));
+      });
+
+      result = result && fired <= timers.size() &&
+               queue.size() == expected.size() &&
+               (expected.empty() ? queue.peekMin() == nullptr
+                                 : queue.peekMin()->deadline ==
+                                           *expected.begin() &&
+                                       *expected.begin() > now);
+    }
+    return result && queue.verifyTree();
+  }
+
+  // popMin() drains in deadline order, equal ones included
+  bool verifyPop() {
+    vector<TimerNode> timers(1000);
+    Queue queue;
+    mt19937 rng(20240627);
+
+    for (auto &timer : timers) {
+      timer.deadline = rng() % 100;
+      queue.push(&timer);
+    }
+
+    u64 latest = 0;
+    size_t popped = 0;
+    auto result = queue.peekMax()->deadline == 99;
+    for (auto timer = queue.popMin(); timer != nullptr;
+         timer = queue.popMin()) {
+      result = result && timer->deadline >= latest;
+      latest = timer->deadline;
+      popped++;
+    }
+    return result && popped == timers.size() && queue.empty();
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbTimerQueue)
+#endif
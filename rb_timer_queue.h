@@ -0,0 +1,81 @@
+#ifndef __RB_TIMER_QUEUE_H__
+#define __RB_TIMER_QUEUE_H__
+
+#include "rb_finger_tree.h"
+
+using namespace std;
+
+/*
+ * Deadline queue: timers are intrusive values ordered by the deadline
+ * KeyOf extracts, `Key` being the clock type. Built on RbFingerTree, so
+ * the earliest timer is cached and peekMin() is O(1), and popMin() only
+ * unlinks the leftmost node, which has no left child and at most a red
+ * leaf on its right. Timers armed with a fixed timeout come in deadline
+ * order, so push() appends them in O(1) amortized. Any other push() goes
+ * through insertHint() from the last timer pushed: O(log d) for a
+ * deadline d timers away while d is small, O(log n) past that.
+ *
+ * Unlike a heap a timer can be cancelled where it stands, and unlike a
+ * timer wheel deadlines are exact and need no ticking through empty
+ * slots. Timers of equal deadline pop in no particular order.
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity,
+          class Hook = RbBaseHook<T>>
+class RbTimerQueue : private RbFingerTree<T, Key, Compare, KeyOf, Hook> {
+public:
+  using Tree = RbFingerTree<T, Key, Compare, KeyOf, Hook>;
+  using Value = typename Tree::Value;
+
+  RbTimerQueue(Compare compare = Compare{}, KeyOf keyOf = KeyOf{})
+      : Tree{compare, keyOf} {}
+
+  // arm a timer, which must not be queued already
+  RbTimerQueue &push(Value *value) {
+    Tree::insertNode(value);
+    return *this;
+  }
+
+  // cancel a timer still queued
+  RbTimerQueue &erase(Value *value) {
+    Tree::deleteNode(value);
+    return *this;
+  }
+
+  // the earliest timer, nullptr if none
+  Value *peekMin() const { return Tree::first(); }
+  Value *peekMax() const { return Tree::last(); }
+
+  // dequeue the earliest timer, nullptr if none
+  Value *popMin() {
+    auto value = Tree::first();
+    if (value != nullptr)
+      erase(value);
+    return value;
+  }
+
+  /*
+   * Dequeue every timer due by `now` and hand it to fire(Value *) in
+   * deadline order, returning how many fired. A timer is out of the
+   * queue by the time it fires, so `fire` may push it again; pushed for
+   * no later than `now`, it fires again in this very call.
+   */
+  template <class F> size_t popExpired(const Key &now, F &&fire) {
+    size_t fired = 0;
+
+    for (auto value = Tree::first();
+         value != nullptr && !this->compareKeyNode(now, Hook::toNode(value));
+         value = Tree::first()) {
+      erase(value);
+      fire(value);
+      fired++;
+    }
+    return fired;
+  }
+
+  using Tree::clear;
+  using Tree::empty;
+  using Tree::forEachInorder;
+  using Tree::size;
+  using Tree::verifyTree;
+};
+#endif
@@ -0,0 +1,96 @@
+#include "rb_topdown_tree.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+struct Entry {
+  int get() const { return key; }
+
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+};
+
+using EntryNode = RbNode<Entry, RbNoAugment, RbBareLayout>;
+// the int key plus two words of links
+static_assert(sizeof(EntryNode) == 3 * sizeof(void *));
+
+// the int key plus two 32-bit slots into one array of nodes
+using IndexArena = RbIndexArena<Entry>;
+using IndexLayout = RbIndexBareLayout<IndexArena>;
+using IndexNode = RbNode<Entry, RbNoAugment, IndexLayout>;
+using IndexTree = RbTopDownTree<Entry, int, less<>, RbIdentity,
+                                RbBaseHook<Entry, RbNoAugment, IndexLayout>>;
+static_assert(sizeof(IndexNode) == 12);
+
+class TestcaseRbTopDownTree : public TestcaseBase {
+public:
+  virtual void testRoutine() override {
+    vector<EntryNode> nodes(3000);
+    vector<IndexNode> indexNodes(3000);
+
+    IndexArena::base = indexNodes.data();
+    if (verifyLayout<RbTopDownTree<Entry, int>>(nodes) &&
+        verifyLayout<IndexTree>(indexNodes)) {
+      std::cout << "top-down tree verified!" << endl;
+    } else {
+      std::cout << "top-down tree failed" << endl;
+    }
+  }
+
+  template <class Tree, class Node> bool verifyLayout(vector<Node> &nodes) {
+    Tree tree;
+    vector<bool> linked(nodes.size());
+    multiset<int> expected;
+    mt19937 rng(20240613);
+    auto result = true;
+
+    for (int round = 0; round < 20000 && result; round++) {
+      auto i = rng() % nodes.size();
+      if (linked[i]) {
+        tree.deleteNode(&nodes[i]);
+        expected.erase(expected.find(nodes[i].key));
+      } else {
+        nodes[i].key = rng() % 1000;
+        tree.insertNode(&nodes[i]);
+        expected.insert(nodes[i].key);
+      }
+      linked[i] = !linked[i];
+
+      if (round % 100 == 0)
+        result = tree.verifyTree();
+    }
+
+    vector<int> keys;
+    tree.forEachInorder([&](Node *node) { keys.push_back(node->key); });
+
+    auto bound = tree.lowerBound(500);
+    auto expectedBound = expected.lower_bound(500);
+    result = result && tree.verifyTree() &&
+             ranges::equal(keys, expected) &&
+             (bound == nullptr) == (expectedBound == expected.end()) &&
+             (bound == nullptr || bound->key == *expectedBound) &&
+             tree.first()->key == *expected.begin() &&
+             tree.last()->key == *expected.rbegin();
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (linked[i])
+        tree.deleteNode(&nodes[i]);
+    }
+    return result && tree.empty();
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbTopDownTree)
+#endif
@@ -0,0 +1,346 @@
+#ifndef __RB_TOPDOWN_TREE_H__
+#define __RB_TOPDOWN_TREE_H__
+
+#include "rb_tree.h"
+#include <functional>
+
+using namespace std;
+
+/*
+ * Red-black tree without parent links: insertNode() and deleteNode()
+ * rebalance in a single pass on the way down (color flips and rotations
+ * ahead of the leaf), so nothing ever climbs back up. With RbBareLayout
+ * a node carries two words of links, with RbIndexBareLayout two 32-bit
+ * slots into an arena. There are no iterators stepping from an arbitrary
+ * node, walks go through forEachInorder().
+ *
+ * Nodes with equal keys are told apart by their address, so deleteNode()
+ * descends straight to the very node it is given.
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity,
+          class Hook = RbBaseHook<T, RbNoAugment, RbBareLayout>>
+class RbTopDownTree {
+public:
+  using Node = typename Hook::Node;
+  using Value = typename Hook::Value;
+
+  static_assert(!Hook::Augment::Enabled,
+                "summaries need bottom-up upkeep, use RbTree");
+
+  RbTopDownTree(Compare compare = Compare{}, KeyOf keyOf = KeyOf{})
+      : compare_{compare}, keyOf_{keyOf} {}
+
+  RbTopDownTree &insertNode(Value *value);
+  RbTopDownTree &deleteNode(Value *value);
+
+  // forget every node, the tree never owned them
+  void clear() { root_ = nullptr; }
+
+  bool empty() const { return root_ == nullptr; }
+
+  // smallest and largest value, nullptr if the tree is empty
+  Value *first() const { return valueOf(extremeNode(LeftChild)); }
+  Value *last() const { return valueOf(extremeNode(RightChild)); }
+
+  // first node not less than key, nullptr if none
+  Value *lowerBound(const Key &key) {
+    Node *p = root_, *bound = nullptr;
+
+    while (p) {
+      auto di = static_cast<RbNodeDirection>(compareNodeKey(p, key));
+      bound = di == LeftChild ? p : bound;
+      p = p->getNodeChild(di);
+    }
+    return valueOf(bound);
+  }
+
+  // first node greater than key, nullptr if none
+  Value *upperBound(const Key &key) {
+    Node *p = root_, *bound = nullptr;
+
+    while (p) {
+      auto di = static_cast<RbNodeDirection>(!compareKeyNode(key, p));
+      bound = di == LeftChild ? p : bound;
+      p = p->getNodeChild(di);
+    }
+    return valueOf(bound);
+  }
+
+  // return the found node or nullptr if non-exist
+  Value *search(const Key &key) {
+    auto value = lowerBound(key);
+    return value != nullptr && !compareKeyNode(key, Hook::toNode(value))
+               ? value
+               : nullptr;
+  }
+
+  bool contains(const Key &key) { return search(key) != nullptr; }
+
+  /*
+   * In-order walk on an explicit stack, 2 * log2(n + 1) deep at most, so
+   * a fixed array covers any tree that fits in memory. The visitor may
+   * return false to stop early.
+   */
+  template <class F> bool forEachInorder(F &&visit) {
+    Node *stack[MaxHeight];
+    auto top = 0;
+    auto node = root_;
+
+    while (node != nullptr || top > 0) {
+      for (; node != nullptr; node = node->getNodeChild(LeftChild)) {
+        stack[top++] = node;
+      }
+      node = stack[--top];
+      if constexpr (is_void_v<invoke_result_t<F &, Value *>>) {
+        visit(Hook::toValue(node));
+      } else if (!visit(Hook::toValue(node))) {
+        return false;
+      }
+      node = node->getNodeChild(RightChild);
+    }
+    return true;
+  }
+
+  bool verifyTree() {
+    Node *previous = nullptr;
+    auto ordered = forEachInorder([&](Value *value) {
+      auto node = Hook::toNode(value);
+      auto inOrder = previous == nullptr || compareNodes(previous, node);
+      previous = node;
+      return inOrder;
+    });
+    return ordered && (root_ == nullptr || root_->isNodeColor(Black)) &&
+           blackHeight(root_) >= 0;
+  }
+
+private:
+  static constexpr int MaxHeight = 2 * 64;
+
+  // black height of the subtree, -1 if it breaks a red-black property
+  static int blackHeight(Node *node) {
+    if (node == nullptr)
+      return 0;
+
+    if (node->isNodeColor(Red) && (node->getChildColor(LeftChild) == Red ||
+                                   node->getChildColor(RightChild) == Red))
+      return -1;
+
+    auto left = blackHeight(node->getNodeChild(LeftChild));
+    auto right = blackHeight(node->getNodeChild(RightChild));
+    if (left < 0 || left != right)
+      return -1;
+    return left + node->isNodeColor(Black);
+  }
+
+  // put `child` under `parent`, a null parent stands for the root
+  void hangNode(Node *parent, RbNodeDirection di, Node *child) {
+    if (parent != nullptr)
+      parent->linkNodeChild(child, di);
+    else
+      root_ = child;
+  }
+
+  static RbNodeDirection directionOf(Node *parent, Node *node) {
+    return parent != nullptr && parent->getNodeChild(RightChild) == node
+               ? RightChild
+               : LeftChild;
+  }
+
+  // `node` goes down on the `di` side, its red child comes up black
+  static Node *rotateNode(Node *node, RbNodeDirection di) {
+    auto other = static_cast<RbNodeDirection>(!di);
+    auto up = node->getNodeChild(other);
+
+    node->linkNodeChild(up->getNodeChild(di), other);
+    up->linkNodeChild(node, di);
+    node->setNodeColor(Red);
+    up->setNodeColor(Black);
+    return up;
+  }
+
+  static Node *rotateNodeTwice(Node *node, RbNodeDirection di) {
+    auto other = static_cast<RbNodeDirection>(!di);
+
+    node->linkNodeChild(rotateNode(node->getNodeChild(other), other), other);
+    return rotateNode(node, di);
+  }
+
+  Node *extremeNode(RbNodeDirection di) const {
+    auto node = root_;
+    while (node != nullptr && node->getNodeChild(di) != nullptr) {
+      node = node->getNodeChild(di);
+    }
+    return node;
+  }
+
+  static Value *valueOf(Node *node) {
+    return node != nullptr ? Hook::toValue(node) : nullptr;
+  }
+
+  const T &payloadOf(Node *node) { return *Hook::toValue(node); }
+
+  // a strict total order: keys first, then addresses
+  bool compareNodes(Node *a, Node *b) {
+    const auto &keyA = keyOf_(payloadOf(a));
+    const auto &keyB = keyOf_(payloadOf(b));
+    if (compare_(keyA, keyB))
+      return true;
+    return !compare_(keyB, keyA) && less<Node *>{}(a, b);
+  }
+  bool compareNodeKey(Node *node, const Key &key) {
+    return compare_(keyOf_(payloadOf(node)), key);
+  }
+  bool compareKeyNode(const Key &key, Node *node) {
+    return compare_(key, keyOf_(payloadOf(node)));
+  }
+
+  Node *root_ = nullptr;
+  [[no_unique_address]] Compare compare_;
+  [[no_unique_address]] KeyOf keyOf_;
+};
+
+/*
+ * Going down, split every 4-node (black with two red children) by a
+ * color flip, and fix the red-red pair a flip may cause right away with
+ * one or two rotations at the grandparent, whose parent `t` is kept for
+ * that. The new leaf then always hangs under a node with room for it.
+ */
+template <class T, class Key, class Compare, class KeyOf, class Hook>
+RbTopDownTree<T, Key, Compare, KeyOf, Hook> &
+RbTopDownTree<T, Key, Compare, KeyOf, Hook>::insertNode(Value *value) {
+  auto node = Hook::toNode(value);
+
+  node->linkNodeChild(nullptr, LeftChild);
+  node->linkNodeChild(nullptr, RightChild);
+  node->setNodeColor(Red);
+
+  if (root_ == nullptr) {
+    root_ = node;
+  } else {
+    Node *t = nullptr, *g = nullptr, *p = nullptr, *q = root_;
+    auto di = LeftChild, last = LeftChild;
+
+    while (true) {
+      if (q == nullptr) {
+        q = node;
+        p->linkNodeChild(q, di);
+      } else if (q->getChildColor(LeftChild) == Red &&
+                 q->getChildColor(RightChild) == Red) {
+        q->setNodeColor(Red);
+        q->getNodeChild(LeftChild)->setNodeColor(Black);
+        q->getNodeChild(RightChild)->setNodeColor(Black);
+      }
+
+      // the root is black, so a red parent always has a parent
+      if (q->isNodeColor(Red) && p != nullptr && p->isNodeColor(Red)) {
+        auto up = static_cast<RbNodeDirection>(!last);
+        auto gd = directionOf(t, g);
+        hangNode(t, gd,
+                 q == p->getNodeChild(last) ? rotateNode(g, up)
+                                            : rotateNodeTwice(g, up));
+      }
+
+      if (q == node)
+        break;
+
+      last = di;
+      di = static_cast<RbNodeDirection>(compareNodes(q, node));
+      if (g != nullptr)
+        t = g;
+      g = p;
+      p = q;
+      q = q->getNodeChild(di);
+    }
+  }
+
+  root_->setNodeColor(Black);
+  return *this;
+}
+
+/*
+ * Going down, make sure the next node is red (or has a red child on the
+ * way) by flipping colors with the sibling or borrowing from it through
+ * rotations, so the node finally unlinked is red and nothing has to be
+ * fixed afterwards. The descent goes on past the target `f` to its
+ * in-order predecessor `q`, which then takes `f`'s place, links and
+ * color. Rotations may move `f` down, so its parent `fp` is followed.
+ */
+template <class T, class Key, class Compare, class KeyOf, class Hook>
+RbTopDownTree<T, Key, Compare, KeyOf, Hook> &
+RbTopDownTree<T, Key, Compare, KeyOf, Hook>::deleteNode(Value *value) {
+  auto f = Hook::toNode(value);
+  Node *g = nullptr, *p = nullptr, *q = nullptr, *fp = nullptr;
+  auto found = false;
+  auto di = RightChild;
+
+  for (auto next = root_; next != nullptr; next = q->getNodeChild(di)) {
+    auto last = di;
+    g = p;
+    p = q;
+    q = next;
+
+    if (q == f) {
+      found = true;
+      fp = p;
+      di = LeftChild;
+    } else {
+      di = static_cast<RbNodeDirection>(compareNodes(q, f));
+    }
+
+    if (q->isNodeColor(Red) || q->getChildColor(di) == Red)
+      continue;
+
+    auto other = static_cast<RbNodeDirection>(!di);
+    if (q->getChildColor(other) == Red) {
+      // lean the red child our way: q goes down, red
+      auto up = rotateNode(q, di);
+      hangNode(p, last, up);
+      fp = q == f ? up : fp;
+      p = up;
+      continue;
+    }
+
+    auto s = p != nullptr ? p->getNodeChild(static_cast<RbNodeDirection>(!last))
+                          : nullptr;
+    if (s == nullptr)
+      continue;
+
+    if (s->getChildColor(LeftChild) == Black &&
+        s->getChildColor(RightChild) == Black) {
+      p->setNodeColor(Black);
+      s->setNodeColor(Red);
+      q->setNodeColor(Red);
+    } else {
+      // borrow from the sibling: p goes down, q turns red
+      auto gd = directionOf(g, p);
+      auto up = s->getChildColor(last) == Red ? rotateNodeTwice(p, last)
+                                              : rotateNode(p, last);
+      hangNode(g, gd, up);
+      fp = p == f ? up : fp;
+      q->setNodeColor(Red);
+      up->setNodeColor(Red);
+      up->getNodeChild(LeftChild)->setNodeColor(Black);
+      up->getNodeChild(RightChild)->setNodeColor(Black);
+    }
+  }
+
+  if (found) {
+    // q has at most one child
+    auto child = q->getNodeChild(q->getNodeChild(LeftChild) == nullptr
+                                     ? RightChild
+                                     : LeftChild);
+    hangNode(p, directionOf(p, q), child);
+
+    if (q != f) {
+      q->linkNodeChild(f->getNodeChild(LeftChild), LeftChild);
+      q->linkNodeChild(f->getNodeChild(RightChild), RightChild);
+      q->setNodeColor(f->getNodeColor());
+      hangNode(fp, directionOf(fp, f), q);
+    }
+  }
+
+  if (root_ != nullptr)
+    root_->setNodeColor(Black);
+  return *this;
+}
+#endif
@@ -1,456 +1,688 @@
 #include "rb_tree.h"
-#include <stack>
 
 using namespace std;
 
-template <class T, class Key>
-RbTree<T, Key> &RbTree<T, Key>::insertNode(RbNode<T> *node) {
-  RbNode<T> *parent = nullptr, *p;
-  RbNodeDirection di = LeftChild;
+#ifdef _TC_ENABLE
+
+#include "file_stream.h"
+#include "testcase.h"
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+class Test {
+public:
+  Test() {}
+  Test(int key) : key_{key} {}
+
+  int get() const { return key_; }
+
+  void set(int key) { key_ = key; }
+
+  bool operator<(const Test &other) const { return key_ < other.key_; }
+
+  friend bool operator<(const Test &node, int key) { return node.key_ < key; }
 
-  p = root_;
+  friend bool operator<(int key, const Test &node) { return key < node.key_; }
 
-  while (p) {
-    parent = p;
-    di = static_cast<RbNodeDirection>(less<T>{}(*p, *node));
-    p = p->getNodeChild(di);
+private:
+  int key_;
+};
+
+// orders Test by its bare int key, so comparisons inline to a single cmp
+struct TestKeyOf {
+  int operator()(const Test &test) const { return test.get(); }
+};
+
+// subtree sizes and key sums kept side by side
+struct TestSumAugment {
+  struct Summary {
+    size_t size;
+    long sum;
+
+    bool operator==(const Summary &) const = default;
+  };
+  static constexpr bool Enabled = true;
+
+  static Summary identity() { return {0, 0}; }
+  static Summary combine(const Summary &a, const Summary &b) {
+    return {a.size + b.size, a.sum + b.sum};
   }
+  static Summary lift(const Test &test) { return {1, test.get()}; }
+  static size_t sizeOf(const Summary &summary) { return summary.size; }
+};
 
-  if (parent) {
-    parent->setNodeChild(node, di, Red);
-    insertRebalance(node);
-  } else { // root node
-    node->setNodeParent(nullptr, Black, &root_);
+using TestSumNode = RbNode<Test, TestSumAugment>;
+using TestSumTree =
+    RbTree<Test, int, less<>, TestKeyOf, RbBaseHook<Test, TestSumAugment>>;
+static_assert(sizeof(RbNode<Test>) == sizeof(RbNode<Test, RbNoAugment>));
+
+using TestDescTree = RbTree<Test, int, greater<>, TestKeyOf>;
+static_assert(sizeof(TestDescTree) == sizeof(RbNode<Test> *));
+
+// one record indexed twice, by price and by time, through member hooks
+struct ByPrice;
+struct ByTime;
+
+struct Order {
+  int get() const { return id; }
+
+  int id, price, time;
+  RbHook<ByPrice> priceHook;
+  RbHook<ByTime> timeHook;
+};
+
+struct OrderPrice {
+  int operator()(const Order &order) const { return order.price; }
+};
+
+struct OrderTime {
+  int operator()(const Order &order) const { return order.time; }
+};
+
+using OrderPriceTree =
+    RbTree<Order, int, less<>, OrderPrice,
+           RbMemberHook<Order, RbHook<ByPrice>, &Order::priceHook>>;
+using OrderTimeTree =
+    RbTree<Order, int, less<>, OrderTime,
+           RbMemberHook<Order, RbHook<ByTime>, &Order::timeHook>>;
+
+// 32-bit links into a single array of nodes
+using TestCompactLayout = RbIndexLayout<RbIndexArena<Test>>;
+using TestCompactNode = RbNode<Test, RbNoAugment, TestCompactLayout>;
+using TestCompactTree =
+    RbTree<Test, int, less<>, TestKeyOf,
+           RbBaseHook<Test, RbNoAugment, TestCompactLayout>>;
+static_assert(sizeof(TestCompactNode) == 16 && sizeof(RbNode<Test>) == 32);
+
+// instrumented, with counters of its own
+using TestStats = RbTreeStats<Test>;
+using TestStatsTree =
+    RbTree<Test, int, less<>, TestKeyOf, RbBaseHook<Test>, TestStats>;
+static_assert(sizeof(TestStatsTree) == sizeof(TestDescTree));
+
+class TestcaseRbTree : public TestcaseBase {
+public:
+  /*
+   * expects the keys inserted by testRoutine():
+   * -158 -56 -1 1 3 5 6 8 10 10 28 158 166
+   */
+  bool verifyLookup(RbTree<Test, int> &tree) {
+    auto [first, last] = tree.equalRange(10);
+    auto result = true;
+
+    if (first == nullptr || first->get() != 10 || last == nullptr ||
+        last->get() != 28 || tree.search(10) != first) {
+      std::cout << "equalRange(10) failed" << endl;
+      result = false;
+    }
+    if (tree.search(7) != nullptr || tree.contains(0) ||
+        !tree.contains(-158) || !tree.contains(166)) {
+      std::cout << "search failed" << endl;
+      result = false;
+    }
+    if (tree.lowerBound(7)->get() != 8 || tree.upperBound(8)->get() != 10 ||
+        tree.lowerBound(-1000)->get() != -158 ||
+        tree.upperBound(166) != nullptr || tree.lowerBound(167) != nullptr) {
+      std::cout << "bounds failed" << endl;
+      result = false;
+    }
+    return result;
   }
 
-#ifdef _TC_ENABLE
-  if (!verifyTree())
-    dumpTree();
-#endif
+  bool verifyPolicy() {
+    TestDescTree tree;
+    RbNode<Test> nodes[] = {4, 9, -3, 7, 7, 0, 12};
+    auto result = true;
 
-  return *this;
-}
-
-template <class T, class Key>
-void RbTree<T, Key>::insertRebalance(RbNode<T> *node) {
-  RbNode<T> *p, *gp;
-  RbNodeDirection nd, pd;
-
-  while (true) {
-    p = node->getNodeParent();
-
-    if (p == nullptr) { // node is root
-      // recursive routine may set root to Red
-      node->setNodeParent(nullptr, Black, &root_);
-      break;
-    }
-
-    if (p->getNodeColor() == Black) { // done
-      break;
-    }
-
-    gp = p->getNodeParent();
-
-    nd = node->getNodeDirection(p);
-    pd = p->getNodeDirection(gp);
-    auto uncle = gp->getTheOtherChildOfColor(pd, Red);
-    if (uncle) {
-      /*
-       * case 1a: B(g)           R(g)
-       *        /   \          /   \
-       *      R(p)  R(u) ->  B(p)  B(u)
-       *      /              /
-       *    R(n)           R(n)
-       *
-       * case 1b: B(g)           R(g)
-       *        /   \          /   \
-       *      R(u)  R(p) ->  B(u)  B(p)
-       *             \              \
-       *             R(n)           R(n)
-       *
-       * case 1c: B(g)           R(g)
-       *        /   \          /   \
-       *      R(p)  R(u) ->  B(p)  B(u)
-       *        \              \
-       *       R(n)           R(n)
-       *
-       * case 1d: B(g)           R(g)
-       *        /   \          /   \
-       *      R(u)  R(p) ->  B(u)  B(p)
-       *            /              /
-       *           R(n)           R(n)
-       *
-       * black node descending, we should move to grand parent to
-       * resolve potential violations
-       */
-      p->setNodeColor(Black);
-      uncle->setNodeColor(Black);
-      node = gp;
-      node->setNodeColor(Red);
-      continue;
-    } else {
-      if (nd != pd) {
-        /*
-         * case 2a: B(g)           B(g)
-         *        /   \          /   \
-         *      R(p)  B(u) ->  R(n)  B(u)
-         *        \            /
-         *       R(n)        R(p)
-         *
-         * case 2b: B(g)           B(g)
-         *        /   \          /   \
-         *      B(u)  R(p) ->  B(u)  R(n)
-         *            /               \
-         *          R(n)              R(p)
-         *
-         * interchange node and parent then pass it to case 3a or 3b
-         */
-        node->rotateWithParent(p, nd, Red);
-
-        // flip direction for case 3a or 3b
-        nd = pd;
-        p = node;
-      }
+    for (auto &node : nodes) {
+      tree.insertNode(&node);
+    }
+    if (!tree.verifyTree()) {
+      std::cout << "descending tree broken" << endl;
+      result = false;
+    }
+    // descending: lowerBound is the first key not greater than the probe
+    if (tree.lowerBound(8)->get() != 7 || tree.upperBound(7)->get() != 4 ||
+        tree.lowerBound(13)->get() != 12 || tree.upperBound(-3) != nullptr ||
+        !tree.contains(0) || tree.contains(5)) {
+      std::cout << "descending lookup failed" << endl;
+      result = false;
+    }
+    for (auto &node : nodes) {
+      tree.deleteNode(&node);
+    }
+    return result;
+  }
 
-      /*
-       * case 3a: B(g)           B(p)
-       *        /   \          /   \
-       *      R(p)  B(u) ->  R(n)  R(g)
-       *      /                     \
-       *    R(n)                    B(u)
-       *
-       * case 3b: B(g)           B(p)
-       *        /   \          /   \
-       *      B(u)  R(p) ->  R(g)  R(n)
-       *             \       /
-       *             R(n)  B(u)
-       * to keep the counts of black node on each direction,
-       * we need to rotate at grand parent
-       */
+  bool verifyMemberHook() {
+    OrderPriceTree byPrice;
+    OrderTimeTree byTime;
+    Order orders[64];
+    auto result = true;
+
+    for (int i = 0; i < 64; i++) {
+      orders[i].id = i;
+      orders[i].price = (i * 37) % 64;
+      orders[i].time = 1000 - i;
+      byPrice.insertNode(&orders[i]);
+      byTime.insertNode(&orders[i]);
+    }
+    for (int i = 0; i < 64; i++) {
+      if (byPrice.search(orders[i].price) != &orders[i] ||
+          byTime.search(orders[i].time) != &orders[i]) {
+        result = false;
+      }
+    }
+    // unlinking from one index leaves the other untouched
+    for (int i = 0; i < 64; i += 2) {
+      byPrice.deleteNode(&orders[i]);
+    }
+    for (int i = 0; i < 64; i++) {
+      if (byPrice.contains(orders[i].price) != (i % 2 == 1) ||
+          byTime.search(orders[i].time) != &orders[i]) {
+        result = false;
+      }
+    }
+    if (!byPrice.verifyTree() || !byTime.verifyTree()) {
+      result = false;
+    }
+    if (!result) {
+      std::cout << "member hook failed" << endl;
+    }
+    return result;
+  }
 
-      p->inheritNodeParent(gp, &root_); // Parent | Direction | Color
+  bool verifyIterator(RbTree<Test, int> &tree, size_t size) {
+    static_assert(bidirectional_iterator<RbTree<Test, int>::Iterator>);
+    static_assert(ranges::bidirectional_range<RbTree<Test, int>>);
 
-      p->rotateWithParent(gp, nd, Red);
+    auto previous = tree.first();
+    size_t count = 0;
+    auto result = true;
 
-      break;
+    // plain range-for, each step follows the parent links
+    for (auto &node : tree) {
+      result = result && !(node < *previous);
+      previous = &node;
+      count++;
+    }
+    if (count != size || ranges::distance(tree) != (ptrdiff_t)size ||
+        !is_sorted(tree.rbegin(), tree.rend(),
+                   [](auto &a, auto &b) { return b < a; })) {
+      result = false;
+    }
+    if (size > 0 && (&*prev(tree.end()) != tree.last() ||
+                     &*tree.rbegin() != tree.last() ||
+                     &*tree.begin() != tree.first())) {
+      result = false;
+    }
+    if (!result) {
+      std::cout << "iterator failed" << endl;
     }
+    return result;
   }
-}
 
-template <class T, class Key>
-RbTree<T, Key> &RbTree<T, Key>::deleteNode(RbNode<T> *node) {
-  RbNode<T> *fix = nullptr;
-  auto left = node->getNodeChild(LeftChild),
-       right = node->getNodeChild(RightChild);
-  auto di = LeftChild;
+  // reference walks with explicit containers, keys in visiting order
+  vector<int> levelOrder(RbTree<Test, int> &tree, bool zigzag) {
+    vector<int> keys;
+    vector<RbNode<Test> *> level;
 
-  if (left == nullptr || right == nullptr) {
-    /*
-     * case 1: if node only have one child, then the child is red
-     * and node itself is black. as long as we change the child to
-     * black, and take over the node, then we break nothing
-     */
-    if (left) { // case 1a
-      left->inheritNodeParent(node, &root_);
-    } else if (right) { // case 1b
-      right->inheritNodeParent(node, &root_);
-    } else {
-      auto p = node->getNodeParent();
-      if (p != nullptr) {
-        di = node->getNodeDirection(p);
-        p->setNodeChild(nullptr, di);
-        if (node->isNodeColor(Black)) {
-          fix = p;
+    if (tree.first() != nullptr) {
+      auto root = tree.first();
+      while (root->getNodeParent() != nullptr)
+        root = root->getNodeParent();
+      level.push_back(root);
+    }
+    for (auto depth = 0; !level.empty(); depth++) {
+      vector<RbNode<Test> *> next;
+      for (auto node : level) {
+        for (auto di : {LeftChild, RightChild}) {
+          if (auto child = node->getNodeChild(di))
+            next.push_back(child);
         }
-      } else {
-        root_ = nullptr;
       }
+      if (zigzag && depth % 2 == 1)
+        ranges::reverse(level);
+      for (auto node : level)
+        keys.push_back(node->get());
+      level = std::move(next);
     }
-  } else {
-    RbNode<T> *farLeft, *nearRight, *x = right;
-
-    do {
-      farLeft = x;
-    } while ((x = x->getNodeChild(LeftChild)));
-
-    nearRight = farLeft->getNodeChild(RightChild);
-    auto needFix = farLeft->isNodeColor(Black) && nearRight == nullptr;
-
-    if (farLeft != right) {
-      /*
-       * case 3a:  X(n)        X(s)
-       *          /  \        /  \
-       *         l    r  ->  l   r
-       *            /           /
-       *           x           x
-       *          /
-       *        Y(s)
-       *         \
-       *         nil
-       * if Y == Black, then we should reblance the tree from x
-       *
-       * case 3b:  X(n)         X(s)
-       *          /  \         /  \
-       *         l   r        l    r
-       *           /              /
-       *          x      ->      x
-       *         /              /
-       *      B(s)            B(ss)
-       *         \
-       *         R(ss)
-       * we let s inherit n, ss change to black, then
-       * there's no harm on all pathes
-       */
-
-      fix = farLeft->getNodeParent();
-      fix->setNodeChild(nearRight, LeftChild, Black);
-      farLeft->hookOldNodeChild(right, RightChild);
-    } else {
-      /*
-       * case 4a:  X(n)          X(s)
-       *          /   \         /  \
-       *         l    Y(s) ->  l   nil
-       *             / \
-       *           nil  nil
-       * if Y == Black, then we should reblance the tree from x
-       *
-       * case 4b:  X(n)           X(s)
-       *          /   \          /   \
-       *         l   B(s)  ->   l    B(r)
-       *             / \
-       *           nil  R(r)
-       */
-      fix = farLeft;
-      di = RightChild;
-      if (nearRight) {
-        nearRight->setNodeColor(Black);
+    return keys;
+  }
+
+  bool verifyTraversal(RbTree<Test, int> &tree) {
+    vector<int> expected, visited;
+    auto collect = [&](RbNode<Test> *node) { visited.push_back(node->get()); };
+    auto record = [&](RbNode<Test> *node) { expected.push_back(node->get()); };
+    auto root = tree.first();
+    auto result = true;
+
+    while (root->getNodeParent() != nullptr)
+      root = root->getNodeParent();
+
+    auto check = [&](const char *name) {
+      if (visited != expected) {
+        std::cout << name << " traversal failed" << endl;
+        result = false;
       }
+      visited.clear();
+      expected.clear();
+    };
+
+    tree.traversalPreorder(root, record);
+    tree.forEachPreorder(collect);
+    check("preorder");
+
+    tree.traversalInorder(root, record);
+    tree.forEachInorder(collect);
+    check("inorder");
+
+    tree.traversalPostorder(root, record);
+    tree.forEachPostorder(collect);
+    check("postorder");
+
+    expected = levelOrder(tree, false);
+    tree.forEachLevelOrder(collect);
+    check("level order");
+
+    expected = levelOrder(tree, true);
+    tree.forEachZigzag(collect);
+    check("zigzag");
+
+    /*
+     *              B(6)
+     *           /        \
+     *        B(3)         B(10)
+     *       /    \       /     \
+     *     R(-1)  B(5)  B(8)     B(158)
+     *     /   \          \      /    \
+     *  B(-56) B(1)      R(10) R(28) R(166)
+     *   /
+     * R(-158)
+     */
+    expected = {6, 3, -1, -56, -158, 1, 5, 10, 28, 166, 158, 10};
+    tree.forEachBoundary(collect);
+    check("boundary");
+
+    // early exit: stop once the 4th node is seen
+    auto seen = 0;
+    if (tree.forEachInorder([&](auto) { return ++seen < 4; }) || seen != 4 ||
+        tree.forEachLevelOrder([&](auto) { return --seen > 0; }) ||
+        seen != 0) {
+      std::cout << "early exit failed" << endl;
+      result = false;
     }
+    return result;
+  }
+
+  bool verifyBulk() {
+    RbNode<Test> evens[200], odds[200];
+    RbNode<Test> *few[3] = {&odds[0], &odds[1], &odds[2]};
+    auto result = true;
+
+    for (int i = 0; i < 200; i++) {
+      evens[i].set(2 * i);
+      odds[i].set(2 * i + 1);
+    }
+
+    for (int size = 0; size <= 200 && result; size++) {
+      RbTree<Test, int> tree;
+
+      tree.buildFromSorted(evens, evens + size);
+      result = tree.verifyTree() && ranges::distance(tree) == size;
 
-    if (!needFix) {
-      fix = nullptr;
+      // as big as the tree: merged then relinked
+      tree.bulkInsert(odds, odds + size);
+      result = result && tree.verifyTree() &&
+               ranges::distance(tree) == 2 * size &&
+               (size == 0 || tree.last()->get() == 2 * size - 1);
     }
 
-    farLeft->inheritNodeParent(node, &root_);
-    farLeft->hookOldNodeChild(left, LeftChild);
+    // tiny batch into a big tree goes through insertNode()
+    RbTree<Test, int> tree;
+    tree.buildFromSorted(evens, evens + 200).bulkInsert(few, few + 3);
+    result = result && tree.verifyTree() && ranges::distance(tree) == 203 &&
+             tree.contains(5) && !tree.contains(7);
+
+    if (!result) {
+      std::cout << "bulk build failed" << endl;
+    }
+    return result;
   }
 
-  if (fix != nullptr) {
-    deleteRebalance(fix, di);
+  bool verifyJoinSplit() {
+    RbNode<Test> nodes[121];
+    auto result = true;
+
+    for (int i = 0; i < 121; i++) {
+      nodes[i].set(i);
+    }
+
+    // every height gap between the sides, both ways
+    for (int pivot = 0; pivot < 121 && result; pivot += 3) {
+      RbTree<Test, int> left, right;
+
+      left.buildFromSorted(nodes, nodes + pivot);
+      right.buildFromSorted(nodes + pivot + 1, nodes + 121);
+      auto tree = RbTree<Test, int>::join(left, &nodes[pivot], right);
+      result = tree.verifyTree() && ranges::distance(tree) == 121 &&
+               ranges::distance(left) == 0 && ranges::distance(right) == 0;
+    }
+
+    for (int key = -1; key <= 121 && result; key++) {
+      RbTree<Test, int> tree;
+
+      tree.buildFromSorted(nodes, nodes + 121);
+      auto [less, rest] = tree.split(key);
+      auto cut = clamp(key, 0, 121);
+      result = less.verifyTree() && rest.verifyTree() &&
+               ranges::distance(less) == cut &&
+               ranges::distance(rest) == 121 - cut &&
+               (cut == 0 || less.last()->get() == cut - 1) &&
+               (cut == 121 || rest.first()->get() == cut);
+    }
+
+    if (!result) {
+      std::cout << "join/split failed" << endl;
+    }
+    return result;
   }
 
-#ifdef _TC_ENABLE
-  if (!verifyTree())
-    dumpTree();
-#endif
-  return *this;
-}
-
-template <class T, class Key>
-void RbTree<T, Key>::deleteRebalance(RbNode<T> *parent, RbNodeDirection nd) {
-  RbNode<T> *node;
-  while (true) {
-    auto sd = static_cast<RbNodeDirection>(!nd);
-    RbNodeColor color;
-    /*
-     * sibling always exist in the loop, because node is black and
-     * one black shorter than sibling side
-     */
-    auto s = parent->getNodeChildWithColor(sd, color);
-
-    if (color == Red) {
-      /*
-       * case 1a:    B(p)               B(s)
-       *            /   \              /   \
-       *         B(n)  R(s)    ->    R(p)  B(r)
-       *              /  \           /  \
-       *            B(l) B(r)      B(n) B(l) <- this is the new sibling
-       *
-       * case 1b:
-       *          B(p)              B(s)
-       *         /   \             /   \
-       *       R(s)  B(n)   ->  B(l)  R(p)
-       *       /  \                  /  \
-       *     B(l) B(r)             B(r) B(n)
-       *
-       * shift a red node to the other branch, harmless
-       * turn case 1a -> case 2a, case 1b -> case 2b
-       */
-      s->inheritNodeParent(parent, &root_);
-      s->rotateWithParent(parent, sd, Red);
-      s = parent->getNodeChild(sd);
-    }
-
-    auto sc = s->getNodeChilds();
-    RbNodeColor scc[2] = {
-        sc[LeftChild] == nullptr ? Black : sc[LeftChild]->getNodeColor(),
-        sc[RightChild] == nullptr ? Black : sc[RightChild]->getNodeColor(),
-    };
+  bool verifySetOps() {
+    RbNode<Test> twos[100], threes[67];
+    auto result = true;
 
-    if (scc[LeftChild] == Black && scc[RightChild] == Black) {
-      /*
-       * case 2a:    X(p)               X(p) <- this is the new node
-       *            /   \              /   \
-       *         B(n)  B(s)    ->   B(n)   R(s) <- turn sibling's color to red
-       *               / \                / \
-       *            B(l) B(r)          B(l) B(r)
-       *
-       * case 2b:   X(p)               X(p)
-       *           /   \              /   \
-       *        B(s)   B(n)   ->    R(s)  B(n)
-       *        /  \               /  \
-       *     B(l) B(r)          B(l) B(r)
-       *
-       * sibling side reduce a black counter, then both sides are even
-       */
-      s->setNodeColor(Red);
-      node = parent;
-      if (node != root_ && node->isNodeColor(RbNodeColor::Black)) {
-        nd = node->getNodeDirection(node->getNodeParent());
-        parent = node->getNodeParent();
-        continue;
-      } else {
-        break;
+    for (int i = 0; i < 100; i++) {
+      twos[i].set(2 * i);
+    }
+    for (int i = 0; i < 67; i++) {
+      threes[i].set(3 * i);
+    }
+
+    auto expect = [&](RbTree<Test, int> &tree, auto &&keep, int size,
+                      const char *op) {
+      for (int key = 0; key < 200; key++) {
+        if (tree.contains(key) != keep(key)) {
+          result = false;
+        }
       }
-    } else {
-      if (scc[sd] == Black) {
-        /*
-         * case 3a:   X(p)            X(p)
-         *           /  \            /   \
-         *        B(n)  B(s)   ->  B(n)  B(l) <- new sibling
-         *             / \                \
-         *          R(l) B(r)             R(s)
-         *                                 \
-         *                                 B(r)
-         *
-         * case 3a:   X(p)            X(p)
-         *           /  \            /   \
-         *        B(s)  B(n)   ->  B(r)  B(n)
-         *        / \              /
-         *     B(l) R(r)         R(s)
-         *                       /
-         *                     B(l)
-         */
-        sc[nd]->inheritNodeParent(s, &root_);
-        sc[nd]->rotateWithParent(s, nd, Red);
-        s = s->getNodeParent();
+      if (!tree.verifyTree() || ranges::distance(tree) != size) {
+        result = false;
+      }
+      if (!result) {
+        std::cout << op << " failed" << endl;
       }
-      /*
-       * case 4a:  X(p)              X(s)
-       *          /   \             /   \
-       *       B(n)   B(s)   ->  B(p)  B(r)
-       *             / \         /  \
-       *          X(l) R(r)    B(n) X(l)
-       *
-       * case 4b:  X(p)              X(s)
-       *          /   \             /   \
-       *       B(s)   B(n)   ->  B(l)  B(p)
-       *       / \                     / \
-       *    R(l) X(r)               X(r) B(n)
-       *
-       * both sides are even, next node is the root
-       */
-      s->inheritNodeParent(parent, &root_);
-      s->rotateWithParent(parent, sd, Black);
-      s->setNodeChildColor(sd, Black);
-      node = root_;
-      break;
+    };
+
+    RbTree<Test, int> a, b;
+    a.buildFromSorted(twos, twos + 100);
+    b.buildFromSorted(threes, threes + 67);
+    a.intersectWith(b);
+    expect(a, [](int key) { return key % 6 == 0; }, 34, "intersection");
+
+    a.buildFromSorted(twos, twos + 100);
+    a.differenceWith(b);
+    expect(a, [](int key) { return key % 2 == 0 && key % 3 != 0; }, 66,
+           "difference");
+
+    // multiset union: shared keys show up twice
+    a.buildFromSorted(twos, twos + 100);
+    a.unionWith(b);
+    expect(a, [](int key) { return key % 2 == 0 || key % 3 == 0; }, 167,
+           "union");
+    if (ranges::distance(b) != 0) {
+      result = false;
     }
+    return result;
   }
-  node->setNodeColor(Black);
-}
-
-template <class T, class Key> bool RbTree<T, Key>::verifyProperties() {
-  if (root_ == nullptr)
-    return true;
-  if (!root_->isNodeColor(Black))
-    return false;
-
-  stack<pair<RbNode<T> *, int>> s;
-  s.push({root_, 0});
-  int pathBlackCount = InitialBlackCounter;
-
-  while (!s.empty()) {
-    auto [node, blackCount] = s.top();
-    s.pop();
-
-    if (node == nullptr) {
-      if (pathBlackCount == InitialBlackCounter) {
-        pathBlackCount = blackCount;
-      } else if (pathBlackCount != blackCount) {
-        return false;
-      }
-      continue;
+
+  bool verifyAugment() {
+    TestSumNode nodes[500];
+    TestSumTree tree;
+    vector<int> keys;
+    auto result = true;
+
+    for (int i = 0; i < 500; i++) {
+      nodes[i].set((i * 7919) % 311 - 150);
+      tree.insertNode(&nodes[i]);
+    }
+    for (int i = 0; i < 500; i += 3) {
+      tree.deleteNode(&nodes[i]);
+    }
+    for (auto &node : tree) {
+      keys.push_back(node.get());
     }
 
-    if (node->isNodeColor(Red)) {
-      if (node->getChildColor(LeftChild) == Red ||
-          node->getChildColor(RightChild) == Red) {
-        return false;
+    for (size_t k = 0; k < keys.size(); k++) {
+      auto node = tree.select(k);
+      if (node == nullptr || node->get() != keys[k] || tree.rank(node) != k) {
+        result = false;
+      }
+    }
+    for (int lo = -160; lo < 160; lo += 7) {
+      for (int hi = lo; hi < 170; hi += 11) {
+        auto first = ranges::lower_bound(keys, lo);
+        auto last = ranges::lower_bound(keys, hi);
+        auto folded = tree.foldRange(lo, hi);
+        if (tree.countRange(lo, hi) != (size_t)(last - first) ||
+            folded.sum != accumulate(first, last, 0L)) {
+          result = false;
+        }
       }
-    } else {
-      blackCount++;
+    }
+    if (tree.select(keys.size()) != nullptr ||
+        tree.summary().size != keys.size() || !tree.verifyTree()) {
+      result = false;
     }
 
-    auto childs = node->getNodeChilds();
-    if (childs[RightChild] != nullptr)
-      s.push({childs[RightChild], blackCount});
-    if (childs[LeftChild] != nullptr)
-      s.push({childs[LeftChild], blackCount});
-  }
+    // structural operations keep the summaries too
+    auto [less, rest] = tree.split(0);
+    result = result && less.verifyTree() && rest.verifyTree() &&
+             less.summary().size + rest.summary().size == keys.size();
+    less.unionWith(rest);
+    result = result && less.verifyTree() && less.summary().size == keys.size();
 
-  return true;
-}
+    if (!result) {
+      std::cout << "augmentation failed" << endl;
+    }
+    return result;
+  }
 
-template <class T, class Key>
-bool RbTree<T, Key>::verifyProperties(RbNode<T> *node, int *blackCount,
-                                      int currentBlackCount) {
+  // hints anywhere in the tree, near or far, summaries kept up to date
+  bool verifyInsertHint() {
+    vector<TestSumNode> nodes(2000);
+    vector<int> keys, expected;
+    TestSumTree tree;
+    mt19937 rng(20240624);
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+      nodes[i].set(rng() % 500);
+      expected.push_back(nodes[i].get());
+      tree.insertHint(i > 0 ? &nodes[rng() % i] : nullptr, &nodes[i]);
+    }
+    for (auto &node : tree) {
+      keys.push_back(node.get());
+    }
+    ranges::sort(expected);
 
-  if (node == nullptr) {
-    if (*blackCount == InitialBlackCounter) {
-      *blackCount = currentBlackCount;
+    auto result = tree.verifyTree() && keys == expected &&
+                  tree.summary().size == nodes.size();
+    if (!result) {
+      std::cout << "insert hint failed" << endl;
     }
-    return *blackCount == currentBlackCount;
+    return result;
   }
 
-  if (node->isNodeColor(Red)) {
-    if (node->getChildColor(LeftChild) == Red ||
-        node->getChildColor(RightChild) == Red)
-      return false;
-  } else {
-    currentBlackCount++;
+  bool verifyCompact() {
+    vector<TestCompactNode> nodes(1000);
+    vector<int> expected;
+    TestCompactTree tree;
+    mt19937 rng(20240612);
+    auto result = true;
+
+    RbIndexArena<Test>::base = nodes.data();
+    for (auto &node : nodes) {
+      node.set(rng() % 500);
+      tree.insertNode(&node);
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (i % 3 == 0) {
+        tree.deleteNode(&nodes[i]);
+      } else {
+        expected.push_back(nodes[i].get());
+      }
+    }
+    ranges::sort(expected);
+
+    result = tree.verifyTree() &&
+             equal(tree.begin(), tree.end(), expected.begin(), expected.end(),
+                   [](const Test &a, int b) { return a.get() == b; });
+
+    auto [less, rest] = tree.split(250);
+    result = result && less.verifyTree() && rest.verifyTree() &&
+             less.last()->get() < 250 && rest.first()->get() >= 250;
+
+    if (!result) {
+      std::cout << "compact layout failed" << endl;
+    }
+    return result;
   }
 
-  return verifyProperties(node->getNodeChild(LeftChild), blackCount,
-                          currentBlackCount) &&
-         verifyProperties(node->getNodeChild(RightChild), blackCount,
-                          currentBlackCount);
-}
+  // the snapshot answers like the tree, before and after a refreeze
+  bool verifyFreeze() {
+    vector<RbNode<Test>> nodes(1000);
+    RbTree<Test, int> tree;
+    mt19937 rng(20240614);
+    auto result = tree.freeze().lowerBound(0) == nullptr;
 
-#ifdef _TC_ENABLE
+    for (auto &node : nodes) {
+      node.set(rng() % 2000);
+      tree.insertNode(&node);
+    }
 
-#include "file_stream.h"
-#include "testcase.h"
-#include <iostream>
+    auto frozen = tree.freeze();
+    auto same = [&] {
+      for (int key = -1; key <= 2001; key++) {
+        auto range = frozen.range(key, key + 10);
+        if (frozen.lowerBound(key) != tree.lowerBound(key) ||
+            frozen.upperBound(key) != tree.upperBound(key) ||
+            frozen.contains(key) != tree.contains(key) ||
+            static_cast<long>(range.size()) !=
+                distance(tree.iteratorOf(tree.lowerBound(key)),
+                         tree.iteratorOf(tree.lowerBound(key + 10))) ||
+            (!range.empty() && range.front() != tree.lowerBound(key)))
+          return false;
+      }
+      return frozen.size() == static_cast<size_t>(ranges::distance(tree));
+    };
+    result = result && same();
 
-namespace {
-class Test {
-public:
-  Test() {}
-  Test(int key) : key_{key} {}
+    for (size_t i = 0; i < nodes.size(); i += 3) {
+      tree.deleteNode(&nodes[i]);
+    }
+    tree.freeze(frozen);
+    result = result && same();
 
-  int get() { return key_; }
+    if (!result) {
+      std::cout << "freeze failed" << endl;
+    }
+    return result;
+  }
 
-  void set(int key) { key_ = key; }
+  // batches agree with one search() per key, SIMD and scalar alike
+  bool verifySearchBatch() {
+    vector<TestSumNode> nodes(3000);
+    TestSumTree tree;
+    RbTree<Test, int> plain;
+    vector<RbNode<Test>> plainNodes(500);
+    mt19937 rng(20240615);
+
+    for (auto &node : nodes) {
+      node.set(rng() % 6000);
+      tree.insertNode(&node);
+    }
+    for (auto &node : plainNodes) {
+      node.set(rng() % 1000);
+      plain.insertNode(&node);
+    }
 
-  bool operator<(const Test &other) const { return key_ < other.key_; }
+    vector<int> keys(1001);
+    ranges::generate(keys, [&] { return static_cast<int>(rng() % 6100) - 50; });
+    vector<TestSumNode *> found(keys.size()), frozen(keys.size());
+    vector<RbNode<Test> *> plainFound(keys.size()), plainFrozen(keys.size());
+
+    tree.searchBatch(keys, found);
+    tree.freeze().searchBatch(span<const int>{keys}, span{frozen});
+    plain.searchBatch(keys, plainFound);
+    plain.freeze().searchBatch(span<const int>{keys}, span{plainFrozen});
+
+    auto result = true;
+    for (size_t i = 0; i < keys.size(); i++) {
+      auto expected = tree.search(keys[i]);
+      auto plainExpected = plain.search(keys[i]);
+      result = result && found[i] == expected && frozen[i] == expected &&
+               plainFound[i] == plainExpected &&
+               plainFrozen[i] == plainExpected;
+    }
 
-private:
-  int key_;
-};
+    if (!result) {
+      std::cout << "search batch failed" << endl;
+    }
+    return result;
+  }
+
+  /*
+   * inserts on a thread which is gone by the snapshot, deletes here;
+   * each fixup ends in at most one terminal case, so an insert rotates
+   * at most twice and case 1 of a delete happens at most once
+   */
+  bool verifyStats() {
+    constexpr size_t Count = 1000;
+    vector<RbNode<Test>> nodes(Count);
+    TestStatsTree tree;
+    mt19937 rng(20240622);
+
+    TestStats::reset();
+    thread{[&] {
+      for (auto &node : nodes) {
+        node.set(rng() % 5000);
+        tree.insertNode(&node);
+      }
+    }}.join();
+    for (auto &node : nodes) {
+      tree.lowerBound(node.get());
+      tree.deleteNode(&node);
+    }
+
+    auto stats = TestStats::snapshot();
+    auto &events = stats.events;
+    auto sum = [](auto &counts) { return accumulate(begin(counts), end(counts),
+                                                    uint64_t{0}); };
+    auto result =
+        sum(stats.latencies[RbInsertOp]) == Count &&
+        sum(stats.latencies[RbDeleteOp]) == Count &&
+        sum(stats.depths) >= 2 * Count && events[RbComparisons] > 0 &&
+        events[RbInsertLoops] >= Count && events[RbInsertCase3] > 0 &&
+        events[RbInsertCase2] + events[RbInsertCase3] <= 2 * Count &&
+        events[RbInsertCase3] <= Count && events[RbDeleteCase1] <= Count &&
+        events[RbDeleteCase4] <= Count && events[RbDeleteCase2] > 0 &&
+        stats.rotations() > 0 &&
+        stats.latencyBound(RbInsertOp, 0.5) <=
+            stats.latencyBound(RbInsertOp, 0.99);
+
+    TestStats::reset();
+    result = result && TestStats::snapshot().events[RbComparisons] == 0;
+    if (!result) {
+      std::cout << "stats failed" << endl;
+    }
+    return result;
+  }
 
-class TestcaseRbTree : public TestcaseBase {
-public:
   virtual void testRoutine() override {
     RbTree<Test, int> tree;
     RbNode<Test> a{1}, b{3}, c{8}, d{6}, e{5}, f{10}, g{-1}, h{158}, i{10},
@@ -477,6 +709,14 @@ public:
 
     tree.dumpTree();
 
+    if (verifyLookup(tree)) {
+      std::cout << "lookup verified!" << endl;
+    }
+
+    if (verifyTraversal(tree)) {
+      std::cout << "traversal verified!" << endl;
+    }
+
     tree.deleteNode(&h)
         .deleteNode(&i)
         .deleteNode(&g)
@@ -504,9 +744,53 @@ public:
       std::cout << "red black verified!" << endl;
     }
 
+    if (verifyIterator(tree, 1000)) {
+      std::cout << "iterator verified!" << endl;
+    }
+
     for (int i = 0; i < 1000; i++) {
       tree.deleteNode(&nodes[i]);
     }
+
+    if (verifyPolicy()) {
+      std::cout << "compare policy verified!" << endl;
+    }
+
+    if (verifyMemberHook()) {
+      std::cout << "member hook verified!" << endl;
+    }
+
+    if (verifyBulk()) {
+      std::cout << "bulk build verified!" << endl;
+    }
+
+    if (verifyJoinSplit() && verifySetOps()) {
+      std::cout << "join/split verified!" << endl;
+    }
+
+    if (verifyAugment()) {
+      std::cout << "augmentation verified!" << endl;
+    }
+
+    if (verifyCompact()) {
+      std::cout << "compact layout verified!" << endl;
+    }
+
+    if (verifyInsertHint()) {
+      std::cout << "insert hint verified!" << endl;
+    }
+
+    if (verifyFreeze()) {
+      std::cout << "freeze verified!" << endl;
+    }
+
+    if (verifySearchBatch()) {
+      std::cout << "search batch verified!" << endl;
+    }
+
+    if (verifyStats()) {
+      std::cout << "stats verified!" << endl;
+    }
   }
 };
 } // namespace
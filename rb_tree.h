@@ -1,9 +1,21 @@
 #ifndef __RB_TREE_H__
 #define __RB_TREE_H__
 
+#include "rb_frozen_tree.h"
+#include "rb_stats.h"
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstdint>
 #include <cstdio>
 #include <functional>
+#include <iterator>
+#include <span>
+#include <stack>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -18,86 +30,309 @@ enum RbNodeDirection {
   RightChild = true,
 };
 
-template <class T> class RbNode : public T {
+/*
+ * Augmentation policies keep a `Summary` of every subtree in its root
+ * node, maintained through rotations and rebalancing. They form a monoid:
+ *   identity()      summary of an empty subtree
+ *   combine(a, b)   summary of `a` followed by `b` in order, associative
+ *   lift(payload)   summary of a single node
+ * RbNoAugment stores nothing and compiles every upkeep away.
+ */
+struct RbNoAugment {
+  struct Summary {};
+  static constexpr bool Enabled = false;
+
+  static Summary identity() { return {}; }
+  static Summary combine(const Summary &, const Summary &) { return {}; }
+  template <class T> static Summary lift(const T &) { return {}; }
+};
+
+// subtree sizes, which is all order statistics need
+struct RbSizeAugment {
+  using Summary = size_t;
+  static constexpr bool Enabled = true;
+
+  static Summary identity() { return 0; }
+  static Summary combine(Summary a, Summary b) { return a + b; }
+  template <class T> static Summary lift(const T &) { return 1; }
+  static size_t sizeOf(Summary summary) { return summary; }
+};
+
+/*
+ * Link layouts store a node's parent, color and children. They all offer
+ * the same primitives to RbLinks, which builds everything else on them:
+ *   linkedParent(), linkedColor(), linkedChild(di)     read
+ *   linkParent(parent, color), linkColor(), linkChild()  write
+ *
+ * RbPointerLayout: the parent address with the color packed into its
+ * lowest bit, plus two child pointers, 24 bytes on 64-bit targets.
+ */
+struct RbPointerLayout {
+  template <class Node> class Links {
+  protected:
+    Node *linkedParent() const { return reinterpret_cast<Node *>(addr_ & ~1); }
+    RbNodeColor linkedColor() const {
+      return static_cast<RbNodeColor>(addr_ & 1);
+    }
+    Node *linkedChild(RbNodeDirection di) const { return childs_[di]; }
+
+    void linkParent(Node *parent, RbNodeColor color) {
+      addr_ = reinterpret_cast<unsigned long>(parent) | color;
+    }
+    void linkColor(RbNodeColor color) { addr_ = (addr_ & ~1) | color; }
+    void linkChild(RbNodeDirection di, Node *child) { childs_[di] = child; }
+
+  private:
+    unsigned long addr_;
+    Node *childs_[2] = {nullptr, nullptr};
+  };
+};
+
+/*
+ * RbIndexLayout: every node sits in one array and links are 32-bit slots
+ * into it, the color being the lowest bit of the parent word: 12 bytes,
+ * up to 2^31 - 1 nodes. `Arena` maps slots and nodes both ways:
+ *   template <class Node> static Node *nodeAt(uint32_t slot)
+ *   template <class Node> static uint32_t slotOf(const Node *node)
+ */
+template <class Arena> struct RbIndexLayout {
+  template <class Node> class Links {
+  protected:
+    Node *linkedParent() const { return nodeOf(parent_ >> 1); }
+    RbNodeColor linkedColor() const {
+      return static_cast<RbNodeColor>(parent_ & 1);
+    }
+    Node *linkedChild(RbNodeDirection di) const { return nodeOf(childs_[di]); }
+
+    void linkParent(Node *parent, RbNodeColor color) {
+      parent_ = slotOf(parent) << 1 | color;
+    }
+    void linkColor(RbNodeColor color) { parent_ = (parent_ & ~1u) | color; }
+    void linkChild(RbNodeDirection di, Node *child) {
+      childs_[di] = slotOf(child);
+    }
+
+  private:
+    static constexpr uint32_t Nil = UINT32_MAX >> 1;
+
+    static Node *nodeOf(uint32_t slot) {
+      return slot != Nil ? Arena::template nodeAt<Node>(slot) : nullptr;
+    }
+    static uint32_t slotOf(const Node *node) {
+      return node != nullptr ? Arena::slotOf(node) : Nil;
+    }
+
+    uint32_t parent_;
+    uint32_t childs_[2] = {Nil, Nil};
+  };
+};
+
+/*
+ * default RbIndexLayout arena: a plain array of nodes, `base` is set
+ * before anything is linked, one array per `Tag` at a time
+ */
+template <class Tag = void> struct RbIndexArena {
+  static inline void *base = nullptr;
+
+  template <class Node> static Node *nodeAt(uint32_t slot) {
+    return static_cast<Node *>(base) + slot;
+  }
+  template <class Node> static uint32_t slotOf(const Node *node) {
+    return static_cast<uint32_t>(node - static_cast<const Node *>(base));
+  }
+};
+
+/*
+ * RbBareLayout: no parent link, the node's own color rides in the lowest
+ * bit of its left child pointer, 16 bytes. Only trees which never climb,
+ * like RbTopDownTree, can link such nodes.
+ */
+struct RbBareLayout {
+  template <class Node> class Links {
+  protected:
+    RbNodeColor linkedColor() const {
+      return static_cast<RbNodeColor>(childs_[LeftChild] & 1);
+    }
+    Node *linkedChild(RbNodeDirection di) const {
+      return reinterpret_cast<Node *>(childs_[di] & ~1);
+    }
+
+    void linkColor(RbNodeColor color) {
+      childs_[LeftChild] = (childs_[LeftChild] & ~1) | color;
+    }
+    void linkChild(RbNodeDirection di, Node *child) {
+      childs_[di] = reinterpret_cast<unsigned long>(child) |
+                    (di == LeftChild ? childs_[LeftChild] & 1 : 0);
+    }
+
+  private:
+    unsigned long childs_[2] = {0, 0};
+  };
+};
+
+/*
+ * RbIndexBareLayout: RbBareLayout with the 32-bit slots of RbIndexLayout,
+ * the node's own color riding in the lowest bit of its left slot: 8
+ * bytes, up to 2^31 - 1 nodes in one `Arena`, for trees which never
+ * climb, like RbTopDownTree.
+ */
+template <class Arena> struct RbIndexBareLayout {
+  template <class Node> class Links {
+  protected:
+    RbNodeColor linkedColor() const {
+      return static_cast<RbNodeColor>(left_ & 1);
+    }
+    Node *linkedChild(RbNodeDirection di) const {
+      return nodeOf(di == LeftChild ? left_ >> 1 : right_);
+    }
+
+    void linkColor(RbNodeColor color) { left_ = (left_ & ~1u) | color; }
+    void linkChild(RbNodeDirection di, Node *child) {
+      if (di == LeftChild)
+        left_ = slotOf(child) << 1 | (left_ & 1);
+      else
+        right_ = slotOf(child);
+    }
+
+  private:
+    static constexpr uint32_t Nil = UINT32_MAX >> 1;
+
+    static Node *nodeOf(uint32_t slot) {
+      return slot != Nil ? Arena::template nodeAt<Node>(slot) : nullptr;
+    }
+    static uint32_t slotOf(const Node *node) {
+      return node != nullptr ? Arena::slotOf(node) : Nil;
+    }
+
+    uint32_t left_ = Nil << 1;
+    uint32_t right_ = Nil;
+  };
+};
+
+/*
+ * Links shared by every hook flavour, on top of a layout. `Node` is the
+ * concrete hook type (CRTP), so links stay typed and a parent link always
+ * leads to the hook itself.
+ */
+template <class Node, class Augmentation = RbNoAugment,
+          class Layout = RbPointerLayout>
+class RbLinks : public Layout::template Links<Node> {
 public:
-  template <class... Args> RbNode(Args... args) : T{args...} {}
+  using Augment = Augmentation;
+  using Summary = typename Augment::Summary;
 
-  void setNodeColor(RbNodeColor color) { addr_ = (addr_ & ~1) | color; }
+  void setNodeColor(RbNodeColor color) { this->linkColor(color); }
 
   void setNodeChildColor(RbNodeDirection di, RbNodeColor color) {
-    if (childs_[di] != nullptr)
-      childs_[di]->setNodeColor(color);
+    if (auto child = getNodeChild(di))
+      child->setNodeColor(color);
   }
 
-  bool isNodeColor(RbNodeColor color) { return (addr_ & 1) == color; }
+  bool isNodeColor(RbNodeColor color) { return this->linkedColor() == color; }
 
-  RbNodeColor getNodeColor() { return static_cast<RbNodeColor>(addr_ & 1); }
+  RbNodeColor getNodeColor() { return this->linkedColor(); }
 
-  RbNodeDirection getNodeDirection(RbNode<T> *parent) {
-    return parent->childs_[LeftChild] == this ? LeftChild : RightChild;
+  RbNodeDirection getNodeDirection(Node *parent) {
+    return parent->getNodeChild(LeftChild) == self() ? LeftChild : RightChild;
   }
 
-  void inheritNodeParent(RbNode<T> *node, RbNode<T> **root) {
-    addr_ = node->addr_;
+  void inheritNodeParent(Node *node, Node **root) {
     auto *parent = node->getNodeParent();
+    this->linkParent(parent, node->getNodeColor());
     if (parent) {
       auto di = node->getNodeDirection(parent);
-      parent->childs_[di] = this;
+      parent->linkChild(di, self());
     } else {
-      *root = this;
+      *root = self();
     }
   }
 
   // root will be updated
-  void setNodeParent(RbNode<T> *parent, RbNodeColor color,
-                     RbNode<T> **root = nullptr) {
-    addr_ = reinterpret_cast<unsigned long>(parent);
-    addr_ |= color;
+  void setNodeParent(Node *parent, RbNodeColor color, Node **root = nullptr) {
+    this->linkParent(parent, color);
     if (parent == nullptr && root != nullptr) {
-      *root = this;
+      *root = self();
     }
   }
 
-  void hookOldNodeChild(RbNode<T> *child, RbNodeDirection di) {
-    childs_[di] = child;
+  void hookOldNodeChild(Node *child, RbNodeDirection di) {
+    this->linkChild(di, child);
     if (child) {
-      child->addr_ = (child->addr_ & 1) | reinterpret_cast<unsigned long>(this);
+      child->linkParent(self(), child->getNodeColor());
     }
   }
 
-  void setNodeChildWithoutColor(RbNode<T> *child, RbNodeDirection di) {
-    childs_[di] = child;
+  void setNodeChildWithoutColor(Node *child, RbNodeDirection di) {
+    this->linkChild(di, child);
     if (child) { // update child's parent
-      child->addr_ = (child->addr_ & 1) | reinterpret_cast<unsigned long>(this);
+      child->linkParent(self(), child->getNodeColor());
     }
   }
 
-  void setNodeChild(RbNode<T> *child, RbNodeDirection di,
+  void setNodeChild(Node *child, RbNodeDirection di,
                     RbNodeColor color = Black) {
-    childs_[di] = child;
+    this->linkChild(di, child);
     if (child) { // update child's parent
-      child->setNodeParent(this, color);
+      child->setNodeParent(self(), color);
     }
   }
 
-  RbNode<T> **getNodeChilds() { return childs_; }
+  // only the child link, for layouts without parent links
+  void linkNodeChild(Node *child, RbNodeDirection di) {
+    this->linkChild(di, child);
+  }
 
-  RbNode<T> *getNodeChild(RbNodeDirection di) { return childs_[di]; }
+  Node *getNodeChild(RbNodeDirection di) { return this->linkedChild(di); }
 
-  RbNode<T> *getNodeParent() {
-    return reinterpret_cast<RbNode<T> *>(addr_ & ~1);
+  Node *getNodeParent() { return this->linkedParent(); }
+
+  const Summary &getNodeSummary() { return summary_; }
+
+  void setNodeSummary(const Summary &summary) { summary_ = summary; }
+
+  // the far end of the subtree in `di` direction, itself if no such child
+  Node *getNodeExtreme(RbNodeDirection di) {
+    auto node = self();
+    while (auto child = node->getNodeChild(di)) {
+      node = child;
+    }
+    return node;
   }
 
+  /*
+   * in-order neighbour on the `di` side, nullptr past either end: the
+   * extreme of the `di` subtree if any, otherwise the first ancestor we
+   * reach from the opposite side. Walking a whole tree touches each link
+   * twice, so stepping is O(1) amortized.
+   */
+  Node *getNodeNeighbour(RbNodeDirection di) {
+    if (auto child = getNodeChild(di)) {
+      return child->getNodeExtreme(static_cast<RbNodeDirection>(!di));
+    }
+
+    auto node = self();
+    auto parent = getNodeParent();
+    while (parent != nullptr && parent->getNodeChild(di) == node) {
+      node = parent;
+      parent = parent->getNodeParent();
+    }
+    return parent;
+  }
+
+  Node *getNodeNext() { return getNodeNeighbour(RightChild); }
+
+  Node *getNodePrev() { return getNodeNeighbour(LeftChild); }
+
   RbNodeColor getChildColor(RbNodeDirection di) {
-    auto child = childs_[di];
+    auto child = getNodeChild(di);
     if (!child)
       return Black;
     else
       return child->getNodeColor();
   }
 
-  RbNode<T> *getNodeChildWithColor(RbNodeDirection di, RbNodeColor &color) {
-    auto child = childs_[di];
+  Node *getNodeChildWithColor(RbNodeDirection di, RbNodeColor &color) {
+    auto child = getNodeChild(di);
     if (!child) {
       color = Black;
     } else {
@@ -106,9 +341,9 @@ public:
     return child;
   }
 
-  RbNode<T> *getTheOtherChildOfColor(RbNodeDirection di, RbNodeColor color) {
+  Node *getTheOtherChildOfColor(RbNodeDirection di, RbNodeColor color) {
     di = static_cast<RbNodeDirection>(!di);
-    auto child = childs_[di];
+    auto child = getNodeChild(di);
 
     if (!child || color != child->getNodeColor())
       return nullptr;
@@ -128,8 +363,7 @@ public:
    * `color` is the node's color, we already known, and will set it
    * to `parent`
    */
-  void rotateWithParent(RbNode<T> *parent, RbNodeDirection di,
-                        RbNodeColor color) {
+  void rotateWithParent(Node *parent, RbNodeDirection di, RbNodeColor color) {
     auto other = static_cast<RbNodeDirection>(!di);
 
     // both sides share the same pattern
@@ -138,78 +372,669 @@ public:
   }
 
 private:
-  unsigned long addr_;
-  RbNode<T> *childs_[2] = {nullptr, nullptr};
+  Node *self() { return static_cast<Node *>(this); }
+
+  [[no_unique_address]] Summary summary_;
 };
 
-template <class T, class Key> class RbTree {
+// base hook: the payload is wrapped by the node, one tree per object
+template <class T, class Augmentation = RbNoAugment,
+          class Layout = RbPointerLayout>
+class RbNode
+    : public T,
+      public RbLinks<RbNode<T, Augmentation, Layout>, Augmentation, Layout> {
 public:
-  RbTree(RbNode<T> *root = nullptr) : root_{root} {}
-  RbTree &insertNode(RbNode<T> *node);
-  RbTree &deleteNode(RbNode<T> *node);
+  template <class... Args>
+  RbNode(Args &&...args) : T{forward<Args>(args)...} {}
+};
+
+/*
+ * member hook: embed one per tree the object should live in, `Tag` only
+ * tells the hooks of one payload apart
+ */
+template <class Tag = void, class Augmentation = RbNoAugment,
+          class Layout = RbPointerLayout>
+class RbHook
+    : public RbLinks<RbHook<Tag, Augmentation, Layout>, Augmentation, Layout> {
+};
+
+/*
+ * Hook policies map between the node the tree links (`Node`) and the
+ * object handed in and out of the tree API (`Value`).
+ */
+template <class T, class Augmentation = RbNoAugment,
+          class Layout = RbPointerLayout>
+struct RbBaseHook {
+  using Node = RbNode<T, Augmentation, Layout>;
+  using Value = Node;
+  using Augment = Augmentation;
+
+  static Value *toValue(Node *node) { return node; }
+  static Node *toNode(Value *value) { return value; }
+};
+
+template <class T, class Hook, Hook T::*Member> struct RbMemberHook {
+  using Node = Hook;
+  using Value = T;
+  using Augment = typename Hook::Augment;
+
+  static Value *toValue(Node *node) {
+    return reinterpret_cast<Value *>(reinterpret_cast<char *>(node) -
+                                     offset());
+  }
+  static Node *toNode(Value *value) { return &(value->*Member); }
+
+private:
+  // folded to a constant, the storage is never constructed nor touched
+  static ptrdiff_t offset() {
+    alignas(T) static char storage[sizeof(T)];
+    auto value = reinterpret_cast<T *>(storage);
+    return reinterpret_cast<char *>(&(value->*Member)) - storage;
+  }
+};
+
+/*
+ * default key extractor: the payload is its own key, paired with the
+ * transparent `less<>` this keeps `T < T`, `T < Key` and `Key < T` working
+ */
+struct RbIdentity {
+  template <class T> const T &operator()(const T &value) const {
+    return value;
+  }
+};
+
+/*
+ * Compare: strict weak order over whatever KeyOf returns, and between
+ *   that and `Key` for lookups
+ * KeyOf: extracts the ordering key from a payload, so one payload type can
+ *   be ordered by different fields in different trees
+ * Stats: instrumentation policy (rb_stats.h), RbNoStats by default
+ * stateless policies take no room thanks to [[no_unique_address]]
+ */
+template <class T, class Key, class Compare = less<>, class KeyOf = RbIdentity,
+          class Hook = RbBaseHook<T>, class Stats = RbNoStats>
+class RbTree {
+public:
+  using Payload = T;
+  using Node = typename Hook::Node;
+  using Value = typename Hook::Value;
+  using Augment = typename Hook::Augment;
+  using Summary = typename Augment::Summary;
+
+  RbTree(Value *root = nullptr, Compare compare = Compare{},
+         KeyOf keyOf = KeyOf{})
+      : root_{root ? Hook::toNode(root) : nullptr}, compare_{compare},
+        keyOf_{keyOf} {}
+  RbTree &insertNode(Value *value);
+  RbTree &deleteNode(Value *value);
+
+  /*
+   * insertNode() from `hint`, a linked value near where `value` belongs,
+   * such as the last one inserted: climb from it only as far as the
+   * first ancestor bounding the new key, then descend from there. A key
+   * next to the hint links below it or its in-order neighbour, O(1)
+   * comparisons. The climb follows at most HintLevels parent links, so
+   * a key d values away costs O(log d) only while d is small; farther
+   * ones, a hint at either end included, pay those few levels and then
+   * a whole descent from the root. A nullptr hint makes it a plain
+   * insertNode().
+   */
+  RbTree &insertHint(Value *hint, Value *value);
+
+  /*
+   * Link an already sorted random access range of values (or of pointers
+   * to values) into a perfectly balanced tree in O(n), no comparison and
+   * no rotation. Every level is black but an incomplete deepest one,
+   * which is red. Whatever the tree linked before is dropped.
+   */
+  template <class It> RbTree &buildFromSorted(It first, It last) {
+    auto size = static_cast<size_t>(distance(first, last));
+    linkSorted([&](size_t i) { return Hook::toNode(pointerOf(first[i])); },
+               size);
+    return *this;
+  }
+
+  /*
+   * Insert a sorted batch. When the batch is big compared to the tree,
+   * merge both in order and relink everything in O(n + k), otherwise
+   * fall back to insertNode(). The tree is only counted as far as
+   * needed to tell which route is cheaper.
+   */
+  template <class It> RbTree &bulkInsert(It first, It last) {
+    auto batch = static_cast<size_t>(distance(first, last));
+    auto worth = [&](size_t size) {
+      return size <= batch * bit_width(size + batch);
+    };
+    size_t size = 0;
+
+    for (auto node = extremeNode(LeftChild); node != nullptr && worth(size);
+         node = node->getNodeNext()) {
+      size++;
+    }
+
+    if (!worth(size)) {
+      for (; first != last; ++first) {
+        insertNode(pointerOf(*first));
+      }
+      return *this;
+    }
+
+    // equal keys: batch first, just like insertNode() puts them left
+    vector<Node *> merged;
+    merged.reserve(size + batch);
+    auto node = extremeNode(LeftChild);
+    for (; first != last; ++first) {
+      auto next = Hook::toNode(pointerOf(*first));
+      for (; node != nullptr && compareNodes(node, next);
+           node = node->getNodeNext()) {
+        merged.push_back(node);
+      }
+      merged.push_back(next);
+    }
+    for (; node != nullptr; node = node->getNodeNext()) {
+      merged.push_back(node);
+    }
+
+    linkSorted([&](size_t i) { return merged[i]; }, merged.size());
+    return *this;
+  }
+
+  // forget every node, the tree never owned them
+  void clear() { root_ = nullptr; }
+
+  /*
+   * Unlink everything, handing each value to `dispose` once the walk is
+   * done with it (postorder), so it may be freed right away.
+   */
+  template <class F> void clear(F &&dispose) {
+    auto node = root_ != nullptr ? postorderFirst(root_) : nullptr;
+    while (node != nullptr) {
+      auto next = postorderNext(node);
+      dispose(Hook::toValue(node));
+      node = next;
+    }
+    root_ = nullptr;
+  }
+
+  /*
+   * In-order bidirectional iterator walking the parent links, the end is
+   * a null node so decrementing it needs to reach back to the tree.
+   * Unlinking the node an iterator points to invalidates only that one.
+   */
+  class Iterator {
+  public:
+    using iterator_category = bidirectional_iterator_tag;
+    using value_type = Value;
+    using difference_type = ptrdiff_t;
+    using pointer = Value *;
+    using reference = Value &;
+
+    Iterator() = default;
+    Iterator(Node *node, const RbTree *tree) : node_{node}, tree_{tree} {}
+
+    reference operator*() const { return *Hook::toValue(node_); }
+    pointer operator->() const { return Hook::toValue(node_); }
+
+    Iterator &operator++() {
+      node_ = node_->getNodeNext();
+      return *this;
+    }
+    Iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+
+    Iterator &operator--() {
+      node_ = node_ != nullptr ? node_->getNodePrev()
+                               : tree_->extremeNode(RightChild);
+      return *this;
+    }
+    Iterator operator--(int) {
+      auto it = *this;
+      --*this;
+      return it;
+    }
+
+    bool operator==(const Iterator &other) const {
+      return node_ == other.node_;
+    }
+
+  private:
+    Node *node_ = nullptr;
+    const RbTree *tree_ = nullptr;
+  };
+
+  using ReverseIterator = reverse_iterator<Iterator>;
+
+  Iterator begin() const { return {extremeNode(LeftChild), this}; }
+  Iterator end() const { return {nullptr, this}; }
+  ReverseIterator rbegin() const { return ReverseIterator{end()}; }
+  ReverseIterator rend() const { return ReverseIterator{begin()}; }
+
+  // iterator positioned at a linked value, end() for nullptr
+  Iterator iteratorOf(Value *value) const {
+    return {value != nullptr ? Hook::toNode(value) : nullptr, this};
+  }
+
+  // smallest and largest value, nullptr if the tree is empty
+  Value *first() const { return valueOf(extremeNode(LeftChild)); }
+  Value *last() const { return valueOf(extremeNode(RightChild)); }
+
+  /*
+   * Structural operations, each O(log n) on top of the existing links:
+   * join() links `left`, `pivot` and `right` (keys in that order) into
+   * one tree, split() cuts a tree into keys less than `key` and the rest.
+   * Both leave their source trees empty.
+   */
+  static RbTree join(RbTree &left, Value *pivot, RbTree &right) {
+    RbTree tree{left};
+
+    tree.root_ =
+        tree.joinParts(left.whole(), Hook::toNode(pivot), right.whole()).root;
+    left.root_ = right.root_ = nullptr;
+    return tree;
+  }
+
+  pair<RbTree, RbTree> split(const Key &key) {
+    pair<RbTree, RbTree> halves{*this, *this};
+    auto [less, rest] = splitParts(
+        whole(), [&](Node *node) { return compareNodeKey(node, key); });
+
+    halves.first.root_ = less.root;
+    halves.second.root_ = rest.root;
+    root_ = nullptr;
+    return halves;
+  }
+
+  /*
+   * Set operations recurse over the nodes of `other` and split this tree
+   * around each of them, O(m log(n / m + 1)) for m nodes in `other`. The
+   * two halves of every step are independent and could run in parallel.
+   * unionWith() moves all nodes of `other` in (equal keys are kept, as in
+   * a multiset) and leaves it empty; intersectWith() and differenceWith()
+   * only read `other` and unlink the nodes of this tree they drop.
+   */
+  RbTree &unionWith(RbTree &other) {
+    root_ = combineParts(whole(), other.root_, other.blackHeight(), SetUnion)
+                .root;
+    other.root_ = nullptr;
+    return *this;
+  }
+
+  RbTree &intersectWith(RbTree &other) {
+    root_ = combineParts(whole(), other.root_, other.blackHeight(),
+                         SetIntersection)
+                .root;
+    return *this;
+  }
+
+  RbTree &differenceWith(RbTree &other) {
+    root_ = combineParts(whole(), other.root_, other.blackHeight(),
+                         SetDifference)
+                .root;
+    return *this;
+  }
+
+  /*
+   * Augmented queries, all O(log n). foldRange() combines the summaries
+   * of the keys in [lo, hi) in order; select(), rank() and countRange()
+   * need an augmentation that counts nodes (Augment::sizeOf()), like
+   * RbSizeAugment.
+   */
+  Summary summary() const {
+    return root_ != nullptr ? root_->getNodeSummary() : Augment::identity();
+  }
+
+  Summary foldRange(const Key &lo, const Key &hi) {
+    auto node = root_;
+
+    // find the top-most node inside the range, the paths split there
+    while (node != nullptr) {
+      if (compareNodeKey(node, lo))
+        node = node->getNodeChild(RightChild);
+      else if (!compareNodeKey(node, hi))
+        node = node->getNodeChild(LeftChild);
+      else
+        break;
+    }
+    if (node == nullptr)
+      return Augment::identity();
+
+    // left side: what is not less than lo, collected right to left
+    auto folded = liftNode(node);
+    for (auto p = node->getNodeChild(LeftChild); p != nullptr;) {
+      if (compareNodeKey(p, lo)) {
+        p = p->getNodeChild(RightChild);
+      } else {
+        auto right = summaryOf(p->getNodeChild(RightChild));
+        folded = Augment::combine(Augment::combine(liftNode(p), right), folded);
+        p = p->getNodeChild(LeftChild);
+      }
+    }
+    // right side: what is less than hi, collected left to right
+    for (auto p = node->getNodeChild(RightChild); p != nullptr;) {
+      if (compareNodeKey(p, hi)) {
+        auto left = summaryOf(p->getNodeChild(LeftChild));
+        folded = Augment::combine(folded, Augment::combine(left, liftNode(p)));
+        p = p->getNodeChild(RightChild);
+      } else {
+        p = p->getNodeChild(LeftChild);
+      }
+    }
+    return folded;
+  }
+
+  size_t countRange(const Key &lo, const Key &hi) {
+    return Augment::sizeOf(foldRange(lo, hi));
+  }
+
+  // the k-th smallest value (0 based), nullptr if k is out of range
+  Value *select(size_t k) {
+    auto node = root_;
+
+    while (node != nullptr) {
+      auto left = node->getNodeChild(LeftChild);
+      auto size = Augment::sizeOf(summaryOf(left));
+      if (k == size)
+        break;
+      if (k < size) {
+        node = left;
+      } else {
+        k -= size + 1;
+        node = node->getNodeChild(RightChild);
+      }
+    }
+    return valueOf(node);
+  }
+
+  // how many values come before `value` in order
+  size_t rank(Value *value) {
+    auto node = Hook::toNode(value);
+    auto rank = Augment::sizeOf(summaryOf(node->getNodeChild(LeftChild)));
+
+    for (auto parent = node->getNodeParent(); parent != nullptr;
+         node = parent, parent = parent->getNodeParent()) {
+      if (parent->getNodeChild(RightChild) == node) {
+        rank +=
+            Augment::sizeOf(summaryOf(parent->getNodeChild(LeftChild))) + 1;
+      }
+    }
+    return rank;
+  }
+
+  /*
+   * Lookups compare `Key` against the extracted key of each node, no
+   * temporary node is built. Equal keys are inserted on the left, so
+   * lowerBound() lands on the first of a run of duplicates.
+   */
+  // first node not less than key, nullptr if none
+  Value *lowerBound(const Key &key) {
+    Node *p = root_, *bound = nullptr;
+    unsigned depth = 0;
+
+    for (; p; depth++) {
+      auto di = static_cast<RbNodeDirection>(compareNodeKey(p, key));
+      bound = di == LeftChild ? p : bound;
+      p = p->getNodeChild(di);
+    }
+    Stats::descent(depth);
+    return valueOf(bound);
+  }
+
+  // first node greater than key, nullptr if none
+  Value *upperBound(const Key &key) {
+    Node *p = root_, *bound = nullptr;
+    unsigned depth = 0;
+
+    for (; p; depth++) {
+      auto di = static_cast<RbNodeDirection>(!compareKeyNode(key, p));
+      bound = di == LeftChild ? p : bound;
+      p = p->getNodeChild(di);
+    }
+    Stats::descent(depth);
+    return valueOf(bound);
+  }
+
+  // [lowerBound, upperBound), nullptr stands for the end
+  pair<Value *, Value *> equalRange(const Key &key) {
+    return {lowerBound(key), upperBound(key)};
+  }
+
   // return the found node or nullptr if non-exist
-  RbNode<T> *search(Key key);
+  Value *search(const Key &key) {
+    auto value = lowerBound(key);
+    return value != nullptr && !compareKeyNode(key, Hook::toNode(value))
+               ? value
+               : nullptr;
+  }
+
+  bool contains(const Key &key) { return search(key) != nullptr; }
+
+  /*
+   * search() for a batch, results[i] for keys[i]. Descents go in groups,
+   * one step of each in turn, and the next node of every one is
+   * prefetched a whole round before it is compared, so their cache
+   * misses overlap instead of adding up.
+   */
+  void searchBatch(span<const Key> keys, span<Value *> results) {
+    constexpr size_t Group = 16;
+
+    for (size_t done = 0; done < keys.size(); done += Group) {
+      auto count = min(Group, keys.size() - done);
+      Node *nodes[Group], *bounds[Group];
+
+      fill_n(nodes, count, root_);
+      fill_n(bounds, count, nullptr);
+      for (auto active = root_ != nullptr; active;) {
+        active = false;
+        for (size_t lane = 0; lane < count; lane++) {
+          auto node = nodes[lane];
+          if (node == nullptr)
+            continue;
+
+          auto di = static_cast<RbNodeDirection>(
+              compareNodeKey(node, keys[done + lane]));
+          bounds[lane] = di == LeftChild ? node : bounds[lane];
+          nodes[lane] = node = node->getNodeChild(di);
+          if (node != nullptr) {
+            __builtin_prefetch(node);
+            __builtin_prefetch(Hook::toValue(node));
+            active = true;
+          }
+        }
+      }
+
+      for (size_t lane = 0; lane < count; lane++) {
+        auto bound = bounds[lane];
+        results[done + lane] =
+            bound != nullptr && !compareKeyNode(keys[done + lane], bound)
+                ? Hook::toValue(bound)
+                : nullptr;
+      }
+    }
+  }
+
+  using Frozen =
+      RbFrozenTree<remove_cvref_t<invoke_result_t<const KeyOf &, const T &>>,
+                   Value, Compare>;
 
   /*
+   * Read-optimized snapshot of the current contents for lookups and range
+   * scans, see RbFrozenTree. It is not kept in sync: freeze again (into
+   * the same snapshot to reuse its storage) after the tree changed.
+   */
+  Frozen freeze() const {
+    Frozen frozen{compare_};
+    freeze(frozen);
+    return frozen;
+  }
+
+  void freeze(Frozen &frozen) const {
+    frozen.rebuild(begin(), end(), [&](const T &payload) -> decltype(auto) {
+      return keyOf_(payload);
+    });
+  }
+
+  /*
+   * recursive traversals over the subtree of `node`, the forEach*()
+   * family below is the iterative, inlined counterpart for whole trees
    * TODO:
-   *  DFS(Depth First Traveral): Inorder, Preorder, Postorder
-   *    recursive version & iterative version
-   *  BFS(Breadth First Traversal): aka Level order Traversal
-   *  Boundary Traveral
    *  Diagonal Traveral
-   *  Zigzag(Spiral) Traversal
    */
-  void traversalPreorder(RbNode<T> *node, function<void(RbNode<T> *)> func) {
+  void traversalPreorder(Node *node, function<void(Value *)> func) {
     if (node != nullptr) {
-      func(node);
+      func(Hook::toValue(node));
       traversalPreorder(node->getNodeChild(LeftChild), func);
       traversalPreorder(node->getNodeChild(RightChild), func);
     }
   }
-  void traversalPostorder(RbNode<T> *node, function<void(RbNode<T> *)> func) {
+  void traversalPostorder(Node *node, function<void(Value *)> func) {
     if (node != nullptr) {
       traversalPostorder(node->getNodeChild(LeftChild), func);
       traversalPostorder(node->getNodeChild(RightChild), func);
-      func(node);
+      func(Hook::toValue(node));
     }
   }
 
-  void traversalInorder(RbNode<T> *node, function<void(RbNode<T> *)> func) {
+  void traversalInorder(Node *node, function<void(Value *)> func) {
     if (node != nullptr) {
       traversalInorder(node->getNodeChild(LeftChild), func);
-      func(node);
+      func(Hook::toValue(node));
       traversalInorder(node->getNodeChild(RightChild), func);
     }
   }
 
+  /*
+   * Iterative traversals: the visitor is inlined rather than wrapped in
+   * a `function`, and every walk moves through the parent links so no
+   * stack or queue is needed. A visitor may return void, or bool where
+   * false stops the walk early; the forEach*() then returns false.
+   */
+  template <class F> bool forEachInorder(F &&visit) {
+    for (auto node = extremeNode(LeftChild); node != nullptr;
+         node = node->getNodeNext()) {
+      if (!visitNode(visit, node))
+        return false;
+    }
+    return true;
+  }
+
+  template <class F> bool forEachPreorder(F &&visit) {
+    auto node = root_;
+
+    while (node != nullptr) {
+      if (!visitNode(visit, node))
+        return false;
+      node = preorderNext(node);
+    }
+    return true;
+  }
+
+  template <class F> bool forEachPostorder(F &&visit) {
+    if (root_ == nullptr)
+      return true;
+
+    auto node = postorderFirst(root_);
+    while (true) {
+      if (!visitNode(visit, node))
+        return false;
+
+      node = postorderNext(node);
+      if (node == nullptr)
+        return true;
+    }
+  }
+
+  /*
+   * Level order without a queue: each level is a depth-limited walk over
+   * the levels above it. With the red-black height bound that is
+   * O(n log n) in the worst case and close to O(n) in practice.
+   */
+  template <class F> bool forEachLevelOrder(F &&visit) {
+    for (int level = 0;; level++) {
+      auto walked = visitLevel(level, LeftChild, visit);
+      if (walked != LevelVisited)
+        return walked == LevelEmpty;
+    }
+  }
+
+  // level order with the direction flipped on every level
+  template <class F> bool forEachZigzag(F &&visit) {
+    for (int level = 0;; level++) {
+      auto first = static_cast<RbNodeDirection>(level & 1);
+      auto walked = visitLevel(level, first, visit);
+      if (walked != LevelVisited)
+        return walked == LevelEmpty;
+    }
+  }
+
+  /*
+   * Anticlockwise boundary: the root, the left boundary top-down, all
+   * leaves left to right, then the right boundary bottom-up. Leaves on
+   * either boundary are only reported with the leaves.
+   */
+  template <class F> bool forEachBoundary(F &&visit) {
+    if (root_ == nullptr)
+      return true;
+    if (!visitNode(visit, root_))
+      return false;
+    if (isLeaf(root_))
+      return true;
+
+    for (auto node = root_->getNodeChild(LeftChild);
+         node != nullptr && !isLeaf(node);
+         node = boundaryNext(node, LeftChild)) {
+      if (!visitNode(visit, node))
+        return false;
+    }
+
+    for (auto node = extremeNode(LeftChild); node != nullptr;
+         node = node->getNodeNext()) {
+      if (isLeaf(node) && !visitNode(visit, node))
+        return false;
+    }
+
+    // find the bottom of the right boundary, then climb back to the root
+    Node *bottom = nullptr;
+    for (auto node = root_->getNodeChild(RightChild);
+         node != nullptr && !isLeaf(node);
+         node = boundaryNext(node, RightChild)) {
+      bottom = node;
+    }
+    for (auto node = bottom; node != nullptr && node != root_;
+         node = node->getNodeParent()) {
+      if (!visitNode(visit, node))
+        return false;
+    }
+    return true;
+  }
+
   /*
    * NOTE: need impl a version of pyramid-sytle dump to output
    */
   void dumpTree() {
-    traversalPreorder(root_, [](RbNode<T> *node) {
-      auto p = node->getNodeParent();
-      auto l = node->getNodeChild(LeftChild);
-      auto r = node->getNodeChild(RightChild);
-      printf("%c(%d): p: %s, l: %s, r: %s\n",
-             node->isNodeColor(Black) ? 'B' : 'R', node->get(),
-             p ? to_string(p->get()).c_str() : "nil",
-             l ? to_string(l->get()).c_str() : "nil",
-             r ? to_string(r->get()).c_str() : "nil");
+    forEachPreorder([](Value *value) {
+      auto node = Hook::toNode(value);
+      printf("%c(%s): p: %s, l: %s, r: %s\n",
+             node->isNodeColor(Black) ? 'B' : 'R', describeNode(node).c_str(),
+             describeNode(node->getNodeParent()).c_str(),
+             describeNode(node->getNodeChild(LeftChild)).c_str(),
+             describeNode(node->getNodeChild(RightChild)).c_str());
     });
   }
 
-  bool verifyProperties(RbNode<T> *node, int *blackCount,
-                        int currentBlackCount);
+  bool verifyProperties(Node *node, int *blackCount, int currentBlackCount);
 
   bool verifyProperties();
 
   bool verifyBST() {
-    function<bool(RbNode<T> *, RbNode<T> *, RbNode<T> *)> checker =
-        [&](RbNode<T> *node, RbNode<T> *left, RbNode<T> *right) {
+    function<bool(Node *, Node *, Node *)> checker =
+        [&](Node *node, Node *left, Node *right) {
           if (node != nullptr) {
-            if (left != nullptr && less<T>{}(*node, *left))
+            if (left != nullptr && compareNodes(node, left))
               return false;
-            if (right != nullptr && less<T>{}(*right, *node))
+            if (right != nullptr && compareNodes(right, node))
               return false;
             return checker(node->getNodeChild(RbNodeDirection::LeftChild), left,
                            node) &&
@@ -230,13 +1055,957 @@ public:
     if (root_->isNodeColor(Red))
       return false;
 
-    return verifyProperties(root_, &count, 0) && verifyBST();
+    return verifyProperties(root_, &count, 0) && verifyBST() &&
+           verifyAugment();
+  }
+
+  // every stored summary matches its subtree, if summaries can be compared
+  bool verifyAugment() {
+    if constexpr (Augment::Enabled && equality_comparable<Summary>) {
+      auto stale = false;
+      forEachPostorder([&](Value *value) {
+        auto node = Hook::toNode(value);
+        auto summary = node->getNodeSummary();
+        refreshNode(node);
+        stale = stale || !(summary == node->getNodeSummary());
+      });
+      return !stale;
+    }
+    return true;
+  }
+
+protected:
+  // for trees built on top, which walk the links and summaries themselves
+  Node *getRootNode() const { return root_; }
+  // for trees whose nodes were linked elsewhere, in a file say
+  void setRootNode(Node *root) { root_ = root; }
+
+  const T &payloadOf(Node *node) { return *Hook::toValue(node); }
+
+  bool compareNodes(Node *a, Node *b) {
+    Stats::count(RbComparisons);
+    return compare_(keyOf_(payloadOf(a)), keyOf_(payloadOf(b)));
+  }
+  bool compareNodeKey(Node *node, const Key &key) {
+    Stats::count(RbComparisons);
+    return compare_(keyOf_(payloadOf(node)), key);
+  }
+  bool compareKeyNode(const Key &key, Node *node) {
+    Stats::count(RbComparisons);
+    return compare_(key, keyOf_(payloadOf(node)));
+  }
+
+  /*
+   * Link `node` as the `di` child of `parent`, nullptr making it the
+   * root, and rebalance. The caller found the place, which must be free.
+   */
+  void linkNode(Node *parent, RbNodeDirection di, Node *node);
+
+  // visitors may return void, or bool with false asking to stop
+  template <class F> static bool visitNode(F &visit, Node *node) {
+    if constexpr (is_void_v<invoke_result_t<F &, Value *>>) {
+      visit(Hook::toValue(node));
+      return true;
+    } else {
+      return visit(Hook::toValue(node));
+    }
   }
 
 private:
   const static int InitialBlackCounter = -1;
-  void insertRebalance(RbNode<T> *node);
-  void deleteRebalance(RbNode<T> *node, RbNodeDirection di);
-  RbNode<T> *root_;
+  // levels insertHint() climbs before starting over from the root
+  const static unsigned HintLevels = 8;
+  // true when the fix-up recolored its way to the root: black height + 1
+  bool insertRebalance(Node *node);
+
+  /*
+   * Augmentation upkeep, all of it vanishes without an augmentation.
+   * A node's summary covers its whole subtree, so it is recomputed from
+   * the children whenever the links below it change.
+   */
+  Summary liftNode(Node *node) { return Augment::lift(payloadOf(node)); }
+
+  static Summary summaryOf(Node *node) {
+    return node != nullptr ? node->getNodeSummary() : Augment::identity();
+  }
+
+  void refreshNode(Node *node) {
+    if constexpr (Augment::Enabled) {
+      node->setNodeSummary(Augment::combine(
+          Augment::combine(summaryOf(node->getNodeChild(LeftChild)),
+                           liftNode(node)),
+          summaryOf(node->getNodeChild(RightChild))));
+    }
+  }
+
+  // from `node` up to the root, every subtree summary on the way changed
+  void refreshPath(Node *node) {
+    if constexpr (Augment::Enabled) {
+      for (; node != nullptr; node = node->getNodeParent()) {
+        refreshNode(node);
+      }
+    }
+  }
+
+  // a rotation only changes the subtrees of the two rotated nodes
+  void rotateNode(Node *node, Node *parent, RbNodeDirection di,
+                  RbNodeColor color) {
+    node->rotateWithParent(parent, di, color);
+    refreshNode(parent);
+    refreshNode(node);
+  }
+  void deleteRebalance(Node *node, RbNodeDirection di);
+
+  // a detached subtree with a black root and its black height
+  struct Part {
+    Node *root = nullptr;
+    int height = 0;
+  };
+
+  enum SetOp {
+    SetUnion,
+    SetIntersection,
+    SetDifference,
+  };
+
+  // black nodes on any path from the root down to a leaf
+  int blackHeight() const {
+    auto height = 0;
+    for (auto node = root_; node != nullptr;
+         node = node->getNodeChild(LeftChild)) {
+      height += node->isNodeColor(Black);
+    }
+    return height;
+  }
+
+  Part whole() const { return {root_, blackHeight()}; }
+
+  /*
+   * cut `node` loose from its parent as a standalone tree, `height` is
+   * the black height of the subtree counting `node` if it is black, a red
+   * root turns black and so adds one level
+   */
+  static Part detach(Node *node, int height) {
+    if (node == nullptr)
+      return {};
+
+    if (node->isNodeColor(Red))
+      height++;
+    node->setNodeParent(nullptr, Black);
+    return {node, height};
+  }
+
+  Part joinParts(Part left, Node *pivot, Part right);
+  Part joinParts(Part left, Part right);
+  Part combineParts(Part part, Node *other, int otherHeight, SetOp op);
+
+  // nodes for which `goesLeft` holds (a prefix of the order) vs the rest
+  template <class F> pair<Part, Part> splitParts(Part part, F &&goesLeft) {
+    auto node = part.root;
+    if (node == nullptr)
+      return {};
+
+    auto height = part.height - node->isNodeColor(Black);
+    auto left = detach(node->getNodeChild(LeftChild), height);
+    auto right = detach(node->getNodeChild(RightChild), height);
+
+    if (goesLeft(node)) {
+      auto [less, rest] = splitParts(right, goesLeft);
+      return {joinParts(left, node, less), rest};
+    } else {
+      auto [less, rest] = splitParts(left, goesLeft);
+      return {less, joinParts(rest, node, right)};
+    }
+  }
+
+  enum LevelWalk {
+    LevelEmpty,   // no node at this depth, the walk is complete
+    LevelVisited, // visited every node at this depth
+    LevelStopped, // visitor asked to stop
+  };
+
+  static bool isLeaf(Node *node) {
+    return node->getNodeChild(LeftChild) == nullptr &&
+           node->getNodeChild(RightChild) == nullptr;
+  }
+
+  // next hop along the `di` boundary: keep to that side while possible
+  static Node *boundaryNext(Node *node, RbNodeDirection di) {
+    auto child = node->getNodeChild(di);
+    return child != nullptr
+               ? child
+               : node->getNodeChild(static_cast<RbNodeDirection>(!di));
+  }
+
+  static Node *preorderNext(Node *node) {
+    if (auto left = node->getNodeChild(LeftChild))
+      return left;
+    if (auto right = node->getNodeChild(RightChild))
+      return right;
+
+    // climb until we leave a left subtree whose parent has a right one
+    for (auto parent = node->getNodeParent(); parent != nullptr;
+         node = parent, parent = parent->getNodeParent()) {
+      auto right = parent->getNodeChild(RightChild);
+      if (right != nullptr && right != node)
+        return right;
+    }
+    return nullptr;
+  }
+
+  // the first node visited in postorder: deepest, preferring the left
+  static Node *postorderFirst(Node *node) {
+    while (true) {
+      if (auto left = node->getNodeChild(LeftChild))
+        node = left;
+      else if (auto right = node->getNodeChild(RightChild))
+        node = right;
+      else
+        return node;
+    }
+  }
+
+  // a parent comes after its right subtree, which comes after the left one
+  static Node *postorderNext(Node *node) {
+    auto parent = node->getNodeParent();
+    if (parent == nullptr)
+      return nullptr;
+
+    auto right = parent->getNodeChild(RightChild);
+    return right != nullptr && right != node ? postorderFirst(right) : parent;
+  }
+
+  // visit every node at depth `level`, children taken `first` side first
+  template <class F>
+  LevelWalk visitLevel(int level, RbNodeDirection first, F &visit) {
+    auto second = static_cast<RbNodeDirection>(!first);
+    auto walked = LevelEmpty;
+    auto node = root_;
+    auto depth = 0;
+
+    while (node != nullptr) {
+      if (depth == level) {
+        if (!visitNode(visit, node))
+          return LevelStopped;
+        walked = LevelVisited;
+      } else if (auto child = node->getNodeChild(first)) {
+        node = child;
+        depth++;
+        continue;
+      } else if (auto child = node->getNodeChild(second)) {
+        node = child;
+        depth++;
+        continue;
+      }
+
+      // climb until an unvisited `second` sibling shows up
+      Node *next = nullptr;
+      for (auto parent = node->getNodeParent(); parent != nullptr;
+           node = parent, parent = parent->getNodeParent()) {
+        depth--;
+        auto sibling = parent->getNodeChild(second);
+        if (sibling != nullptr && sibling != node) {
+          next = sibling;
+          depth++;
+          break;
+        }
+      }
+      node = next;
+    }
+    return walked;
+  }
+
+  // payloads with a printable get() show it, any other their address
+  static string describeNode(Node *node) {
+    if (node == nullptr)
+      return "nil";
+
+    if constexpr (requires(Value *value) { to_string(value->get()); }) {
+      return to_string(Hook::toValue(node)->get());
+    } else {
+      char address[2 * sizeof(void *) + 3];
+      snprintf(address, sizeof(address), "%p", static_cast<void *>(node));
+      return address;
+    }
+  }
+
+  // ranges may hold values or pointers to values
+  static Value *pointerOf(Value &value) { return &value; }
+  static Value *pointerOf(Value *value) { return value; }
+
+  template <class At> void linkSorted(At &&at, size_t size) {
+    // a complete tree (size == 2^h - 1) needs no red level
+    auto redDepth =
+        has_single_bit(size + 1) ? -1 : static_cast<int>(bit_width(size)) - 1;
+
+    root_ = linkSorted(at, 0, size, 0, redDepth);
+    if (root_ != nullptr) {
+      root_->setNodeParent(nullptr, Black);
+    }
+  }
+
+  // link [lo, hi) under the middle one, return that subtree root
+  template <class At>
+  Node *linkSorted(At &at, size_t lo, size_t hi, int depth, int redDepth) {
+    if (lo == hi)
+      return nullptr;
+
+    auto mid = lo + (hi - lo) / 2;
+    auto node = at(mid);
+    auto color = depth + 1 == redDepth ? Red : Black;
+
+    node->setNodeChild(linkSorted(at, lo, mid, depth + 1, redDepth), LeftChild,
+                       color);
+    node->setNodeChild(linkSorted(at, mid + 1, hi, depth + 1, redDepth),
+                       RightChild, color);
+    refreshNode(node);
+    return node;
+  }
+
+  Node *extremeNode(RbNodeDirection di) const {
+    return root_ != nullptr ? root_->getNodeExtreme(di) : nullptr;
+  }
+
+  static Value *valueOf(Node *node) {
+    return node != nullptr ? Hook::toValue(node) : nullptr;
+  }
+
+  Node *root_;
+  [[no_unique_address]] Compare compare_;
+  [[no_unique_address]] KeyOf keyOf_;
 };
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+RbTree<T, Key, Compare, KeyOf, Hook, Stats> &
+RbTree<T, Key, Compare, KeyOf, Hook, Stats>::insertNode(Value *value) {
+  RbStatTimer<Stats> timer{RbInsertOp};
+  auto node = Hook::toNode(value);
+  Node *parent = nullptr, *p;
+  RbNodeDirection di = LeftChild;
+  unsigned depth = 0;
+
+  p = root_;
+
+  for (; p; depth++) {
+    parent = p;
+    di = static_cast<RbNodeDirection>(compareNodes(p, node));
+    p = p->getNodeChild(di);
+  }
+  Stats::descent(depth);
+
+  linkNode(parent, di, node);
+  return *this;
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+RbTree<T, Key, Compare, KeyOf, Hook, Stats> &
+RbTree<T, Key, Compare, KeyOf, Hook, Stats>::insertHint(Value *hint,
+                                                        Value *value) {
+  if (hint == nullptr)
+    return insertNode(value);
+
+  RbStatTimer<Stats> timer{RbInsertOp};
+  auto node = Hook::toNode(value);
+  auto from = Hook::toNode(hint);
+  auto di = static_cast<RbNodeDirection>(compareNodes(from, node));
+  Node *parent = nullptr, *p;
+  unsigned depth = 0;
+
+  /*
+   * The subtree of `from` is bounded on the `di` side by the first
+   * ancestor reached through an edge the other way, its in-order
+   * neighbour there. Once the key falls short of that bound it belongs
+   * on the `di` side of `from`, right below it if that side is empty.
+   * Otherwise the climb goes on from the bound. Every parent link taken
+   * counts against HintLevels: a key farther off than that is better
+   * found from the root, and the climb must not walk a whole spine.
+   */
+  for (unsigned climbed = 0;;) {
+    auto child = from, bound = from->getNodeParent();
+    while (bound != nullptr && child->getNodeDirection(bound) == di &&
+           climbed < HintLevels) {
+      child = bound;
+      bound = bound->getNodeParent();
+      climbed++;
+    }
+    if (bound == nullptr ||
+        (climbed < HintLevels &&
+         static_cast<RbNodeDirection>(compareNodes(bound, node)) != di))
+      break;
+    if (++climbed >= HintLevels) {
+      from = nullptr;
+      break;
+    }
+    from = bound;
+  }
+
+  if (from != nullptr) {
+    parent = from;
+    p = from->getNodeChild(di);
+    depth++;
+  } else {
+    p = root_;
+  }
+  for (; p; depth++) {
+    parent = p;
+    di = static_cast<RbNodeDirection>(compareNodes(p, node));
+    p = p->getNodeChild(di);
+  }
+  Stats::descent(depth);
+
+  linkNode(parent, di, node);
+  return *this;
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+void RbTree<T, Key, Compare, KeyOf, Hook, Stats>::linkNode(Node *parent,
+                                                           RbNodeDirection di,
+                                                           Node *node) {
+  // the node may come straight from another tree, drop its old children
+  node->setNodeChild(nullptr, LeftChild);
+  node->setNodeChild(nullptr, RightChild);
+
+  if (parent) {
+    parent->setNodeChild(node, di, Red);
+    refreshPath(node);
+    insertRebalance(node);
+  } else { // root node
+    node->setNodeParent(nullptr, Black, &root_);
+    refreshNode(node);
+  }
+
+#ifdef _TC_ENABLE
+  if (!verifyTree())
+    dumpTree();
+#endif
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+bool RbTree<T, Key, Compare, KeyOf, Hook, Stats>::insertRebalance(Node *node) {
+  Node *p, *gp;
+  RbNodeDirection nd, pd;
+  auto grown = false;
+
+  while (true) {
+    Stats::count(RbInsertLoops);
+    p = node->getNodeParent();
+
+    if (p == nullptr) { // node is root
+      // recursive routine may set root to Red
+      node->setNodeParent(nullptr, Black, &root_);
+      grown = true;
+      break;
+    }
+
+    if (p->getNodeColor() == Black) { // done
+      break;
+    }
+
+    gp = p->getNodeParent();
+
+    nd = node->getNodeDirection(p);
+    pd = p->getNodeDirection(gp);
+    auto uncle = gp->getTheOtherChildOfColor(pd, Red);
+    if (uncle) {
+      /*
+       * case 1a: B(g)           R(g)
+       *        /   \          /   \
+       *      R(p)  R(u) ->  B(p)  B(u)
+       *      /              /
+       *    R(n)           R(n)
+       *
+       * case 1b: B(g)           R(g)
+       *        /   \          /   \
+       *      R(u)  R(p) ->  B(u)  B(p)
+       *             \              \
+       *             R(n)           R(n)
+       *
+       * case 1c: B(g)           R(g)
+       *        /   \          /   \
+       *      R(p)  R(u) ->  B(p)  B(u)
+       *        \              \
+       *       R(n)           R(n)
+       *
+       * case 1d: B(g)           R(g)
+       *        /   \          /   \
+       *      R(u)  R(p) ->  B(u)  B(p)
+       *            /              /
+       *           R(n)           R(n)
+       *
+       * black node descending, we should move to grand parent to
+       * resolve potential violations
+       */
+      Stats::count(RbInsertCase1);
+      p->setNodeColor(Black);
+      uncle->setNodeColor(Black);
+      node = gp;
+      node->setNodeColor(Red);
+      continue;
+    } else {
+      if (nd != pd) {
+        /*
+         * case 2a: B(g)           B(g)
+         *        /   \          /   \
+         *      R(p)  B(u) ->  R(n)  B(u)
+         *        \            /
+         *       R(n)        R(p)
+         *
+         * case 2b: B(g)           B(g)
+         *        /   \          /   \
+         *      B(u)  R(p) ->  B(u)  R(n)
+         *            /               \
+         *          R(n)              R(p)
+         *
+         * interchange node and parent then pass it to case 3a or 3b
+         */
+        Stats::count(RbInsertCase2);
+        rotateNode(node, p, nd, Red);
+
+        // flip direction for case 3a or 3b
+        nd = pd;
+        p = node;
+      }
+
+      /*
+       * case 3a: B(g)           B(p)
+       *        /   \          /   \
+       *      R(p)  B(u) ->  R(n)  R(g)
+       *      /                     \
+       *    R(n)                    B(u)
+       *
+       * case 3b: B(g)           B(p)
+       *        /   \          /   \
+       *      B(u)  R(p) ->  R(g)  R(n)
+       *             \       /
+       *             R(n)  B(u)
+       * to keep the counts of black node on each direction,
+       * we need to rotate at grand parent
+       */
+
+      Stats::count(RbInsertCase3);
+      p->inheritNodeParent(gp, &root_); // Parent | Direction | Color
+
+      rotateNode(p, gp, nd, Red);
+
+      break;
+    }
+  }
+  return grown;
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+RbTree<T, Key, Compare, KeyOf, Hook, Stats> &
+RbTree<T, Key, Compare, KeyOf, Hook, Stats>::deleteNode(Value *value) {
+  RbStatTimer<Stats> timer{RbDeleteOp};
+  auto node = Hook::toNode(value);
+  Node *fix = nullptr;
+  auto left = node->getNodeChild(LeftChild),
+       right = node->getNodeChild(RightChild);
+  auto di = LeftChild;
+  // the deepest node whose subtree lost something
+  auto changed = node->getNodeParent();
+
+  if (left == nullptr || right == nullptr) {
+    /*
+     * case 1: if node only have one child, then the child is red
+     * and node itself is black. as long as we change the child to
+     * black, and take over the node, then we break nothing
+     */
+    if (left) { // case 1a
+      left->inheritNodeParent(node, &root_);
+    } else if (right) { // case 1b
+      right->inheritNodeParent(node, &root_);
+    } else {
+      auto p = node->getNodeParent();
+      if (p != nullptr) {
+        di = node->getNodeDirection(p);
+        p->setNodeChild(nullptr, di);
+        if (node->isNodeColor(Black)) {
+          fix = p;
+        }
+      } else {
+        root_ = nullptr;
+      }
+    }
+  } else {
+    Node *farLeft, *nearRight, *x = right;
+
+    do {
+      farLeft = x;
+    } while ((x = x->getNodeChild(LeftChild)));
+
+    nearRight = farLeft->getNodeChild(RightChild);
+    auto needFix = farLeft->isNodeColor(Black) && nearRight == nullptr;
+
+    if (farLeft != right) {
+      /*
+       * case 3a:  X(n)        X(s)
+       *          /  \        /  \
+       *         l    r  ->  l   r
+       *            /           /
+       *           x           x
+       *          /
+       *        Y(s)
+       *         \
+       *         nil
+       * if Y == Black, then we should reblance the tree from x
+       *
+       * case 3b:  X(n)         X(s)
+       *          /  \         /  \
+       *         l   r        l    r
+       *           /              /
+       *          x      ->      x
+       *         /              /
+       *      B(s)            B(ss)
+       *         \
+       *         R(ss)
+       * we let s inherit n, ss change to black, then
+       * there's no harm on all pathes
+       */
+
+      fix = changed = farLeft->getNodeParent();
+      fix->setNodeChild(nearRight, LeftChild, Black);
+      farLeft->hookOldNodeChild(right, RightChild);
+    } else {
+      /*
+       * case 4a:  X(n)          X(s)
+       *          /   \         /  \
+       *         l    Y(s) ->  l   nil
+       *             / \
+       *           nil  nil
+       * if Y == Black, then we should reblance the tree from x
+       *
+       * case 4b:  X(n)           X(s)
+       *          /   \          /   \
+       *         l   B(s)  ->   l    B(r)
+       *             / \
+       *           nil  R(r)
+       */
+      fix = changed = farLeft;
+      di = RightChild;
+      if (nearRight) {
+        nearRight->setNodeColor(Black);
+      }
+    }
+
+    if (!needFix) {
+      fix = nullptr;
+    }
+
+    farLeft->inheritNodeParent(node, &root_);
+    farLeft->hookOldNodeChild(left, LeftChild);
+  }
+
+  refreshPath(changed);
+
+  if (fix != nullptr) {
+    deleteRebalance(fix, di);
+  }
+
+#ifdef _TC_ENABLE
+  if (!verifyTree())
+    dumpTree();
+#endif
+  return *this;
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+void RbTree<T, Key, Compare, KeyOf, Hook, Stats>::deleteRebalance(
+    Node *parent, RbNodeDirection nd) {
+  Node *node;
+  while (true) {
+    Stats::count(RbDeleteLoops);
+    auto sd = static_cast<RbNodeDirection>(!nd);
+    RbNodeColor color;
+    /*
+     * sibling always exist in the loop, because node is black and
+     * one black shorter than sibling side
+     */
+    auto s = parent->getNodeChildWithColor(sd, color);
+
+    if (color == Red) {
+      /*
+       * case 1a:    B(p)               B(s)
+       *            /   \              /   \
+       *         B(n)  R(s)    ->    R(p)  B(r)
+       *              /  \           /  \
+       *            B(l) B(r)      B(n) B(l) <- this is the new sibling
+       *
+       * case 1b:
+       *          B(p)              B(s)
+       *         /   \             /   \
+       *       R(s)  B(n)   ->  B(l)  R(p)
+       *       /  \                  /  \
+       *     B(l) B(r)             B(r) B(n)
+       *
+       * shift a red node to the other branch, harmless
+       * turn case 1a -> case 2a, case 1b -> case 2b
+       */
+      Stats::count(RbDeleteCase1);
+      s->inheritNodeParent(parent, &root_);
+      rotateNode(s, parent, sd, Red);
+      s = parent->getNodeChild(sd);
+    }
+
+    RbNodeColor scc[2] = {
+        s->getChildColor(LeftChild),
+        s->getChildColor(RightChild),
+    };
+
+    if (scc[LeftChild] == Black && scc[RightChild] == Black) {
+      /*
+       * case 2a:    X(p)               X(p) <- this is the new node
+       *            /   \              /   \
+       *         B(n)  B(s)    ->   B(n)   R(s) <- turn sibling's color to red
+       *               / \                / \
+       *            B(l) B(r)          B(l) B(r)
+       *
+       * case 2b:   X(p)               X(p)
+       *           /   \              /   \
+       *        B(s)   B(n)   ->    R(s)  B(n)
+       *        /  \               /  \
+       *     B(l) B(r)          B(l) B(r)
+       *
+       * sibling side reduce a black counter, then both sides are even
+       */
+      Stats::count(RbDeleteCase2);
+      s->setNodeColor(Red);
+      node = parent;
+      if (node != root_ && node->isNodeColor(RbNodeColor::Black)) {
+        nd = node->getNodeDirection(node->getNodeParent());
+        parent = node->getNodeParent();
+        continue;
+      } else {
+        break;
+      }
+    } else {
+      if (scc[sd] == Black) {
+        /*
+         * case 3a:   X(p)            X(p)
+         *           /  \            /   \
+         *        B(n)  B(s)   ->  B(n)  B(l) <- new sibling
+         *             / \                \
+         *          R(l) B(r)             R(s)
+         *                                 \
+         *                                 B(r)
+         *
+         * case 3a:   X(p)            X(p)
+         *           /  \            /   \
+         *        B(s)  B(n)   ->  B(r)  B(n)
+         *        / \              /
+         *     B(l) R(r)         R(s)
+         *                       /
+         *                     B(l)
+         */
+        Stats::count(RbDeleteCase3);
+        auto near = s->getNodeChild(nd);
+        near->inheritNodeParent(s, &root_);
+        rotateNode(near, s, nd, Red);
+        s = near;
+      }
+      /*
+       * case 4a:  X(p)              X(s)
+       *          /   \             /   \
+       *       B(n)   B(s)   ->  B(p)  B(r)
+       *             / \         /  \
+       *          X(l) R(r)    B(n) X(l)
+       *
+       * case 4b:  X(p)              X(s)
+       *          /   \             /   \
+       *       B(s)   B(n)   ->  B(l)  B(p)
+       *       / \                     / \
+       *    R(l) X(r)               X(r) B(n)
+       *
+       * both sides are even, next node is the root
+       */
+      Stats::count(RbDeleteCase4);
+      s->inheritNodeParent(parent, &root_);
+      rotateNode(s, parent, sd, Black);
+      s->setNodeChildColor(sd, Black);
+      node = root_;
+      break;
+    }
+  }
+  node->setNodeColor(Black);
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+bool RbTree<T, Key, Compare, KeyOf, Hook, Stats>::verifyProperties() {
+  if (root_ == nullptr)
+    return true;
+  if (!root_->isNodeColor(Black))
+    return false;
+
+  stack<pair<Node *, int>> s;
+  s.push({root_, 0});
+  int pathBlackCount = InitialBlackCounter;
+
+  while (!s.empty()) {
+    auto [node, blackCount] = s.top();
+    s.pop();
+
+    if (node == nullptr) {
+      if (pathBlackCount == InitialBlackCounter) {
+        pathBlackCount = blackCount;
+      } else if (pathBlackCount != blackCount) {
+        return false;
+      }
+      continue;
+    }
+
+    if (node->isNodeColor(Red)) {
+      if (node->getChildColor(LeftChild) == Red ||
+          node->getChildColor(RightChild) == Red) {
+        return false;
+      }
+    } else {
+      blackCount++;
+    }
+
+    if (auto right = node->getNodeChild(RightChild))
+      s.push({right, blackCount});
+    if (auto left = node->getNodeChild(LeftChild))
+      s.push({left, blackCount});
+  }
+
+  return true;
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+bool RbTree<T, Key, Compare, KeyOf, Hook, Stats>::verifyProperties(
+    Node *node, int *blackCount, int currentBlackCount) {
+
+  if (node == nullptr) {
+    if (*blackCount == InitialBlackCounter) {
+      *blackCount = currentBlackCount;
+    }
+    return *blackCount == currentBlackCount;
+  }
+
+  if (node->isNodeColor(Red)) {
+    if (node->getChildColor(LeftChild) == Red ||
+        node->getChildColor(RightChild) == Red)
+      return false;
+  } else {
+    currentBlackCount++;
+  }
+
+  return verifyProperties(node->getNodeChild(LeftChild), blackCount,
+                          currentBlackCount) &&
+         verifyProperties(node->getNodeChild(RightChild), blackCount,
+                          currentBlackCount);
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+auto RbTree<T, Key, Compare, KeyOf, Hook, Stats>::joinParts(Part left,
+                                                            Node *pivot,
+                                                            Part right)
+    -> Part {
+  if (left.height == right.height) {
+    pivot->setNodeChild(left.root, LeftChild, Black);
+    pivot->setNodeChild(right.root, RightChild, Black);
+    pivot->setNodeParent(nullptr, Black);
+    refreshNode(pivot);
+    return {pivot, left.height + 1};
+  }
+
+  /*
+   * walk down the inner spine of the taller tree to the first black node
+   * `c` as high as the shorter tree, then:
+   *
+   *       p                 p
+   *      / \               / \
+   *     x  B(c)    ->     x  R(pivot)
+   *                          /   \
+   *                        B(c)  B(short)
+   *
+   * (mirrored when the right tree is taller), the red pivot may violate
+   * the red rule with `p`, which is exactly what insertRebalance() fixes,
+   * growing the black height if the recoloring reaches the root
+   */
+  auto leftTaller = left.height > right.height;
+  auto tall = leftTaller ? left : right, low = leftTaller ? right : left;
+  auto di = leftTaller ? RightChild : LeftChild;
+  auto other = static_cast<RbNodeDirection>(!di);
+  RbTree tree{*this};
+  Node *parent = nullptr, *c = tall.root;
+
+  for (auto height = tall.height;
+       c != nullptr && !(c->isNodeColor(Black) && height == low.height);
+       c = c->getNodeChild(di)) {
+    height -= c->isNodeColor(Black);
+    parent = c;
+  }
+
+  tree.root_ = tall.root;
+  parent->setNodeChild(pivot, di, Red);
+  pivot->setNodeChild(c, other, Black);
+  pivot->setNodeChild(low.root, di, Black);
+  tree.refreshPath(pivot);
+  auto grown = tree.insertRebalance(pivot);
+
+  return {tree.root_, tall.height + grown};
+}
+
+// join without a pivot: borrow the smallest node of `right`
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+auto RbTree<T, Key, Compare, KeyOf, Hook, Stats>::joinParts(Part left,
+                                                            Part right)
+    -> Part {
+  if (left.root == nullptr)
+    return right;
+  if (right.root == nullptr)
+    return left;
+
+  RbTree tree{*this};
+  tree.root_ = right.root;
+
+  auto pivot = tree.extremeNode(LeftChild);
+  tree.deleteNode(Hook::toValue(pivot));
+  return joinParts(left, pivot, tree.whole());
+}
+
+template <class T, class Key, class Compare, class KeyOf, class Hook,
+          class Stats>
+auto RbTree<T, Key, Compare, KeyOf, Hook, Stats>::combineParts(
+    Part part, Node *other, int otherHeight, SetOp op) -> Part {
+  if (other == nullptr)
+    return op == SetIntersection ? Part{} : part;
+  if (part.root == nullptr)
+    return op == SetUnion ? detach(other, otherHeight) : part;
+
+  // read the links of `other` first, a union relinks it as a pivot
+  auto height = otherHeight - other->isNodeColor(Black);
+  auto otherLeft = other->getNodeChild(LeftChild);
+  auto otherRight = other->getNodeChild(RightChild);
+  auto [less, rest] =
+      splitParts(part, [&](Node *node) { return compareNodes(node, other); });
+
+  if (op == SetUnion) {
+    auto left = combineParts(less, otherLeft, height, op);
+    auto right = combineParts(rest, otherRight, height, op);
+    return joinParts(left, other, right);
+  }
+
+  // peel the nodes equal to `other` off the front of `rest`
+  auto [equal, greater] = splitParts(
+      rest, [&](Node *node) { return !compareNodes(other, node); });
+  auto left = combineParts(less, otherLeft, height, op);
+  auto right = combineParts(greater, otherRight, height, op);
+
+  if (op == SetIntersection)
+    return joinParts(joinParts(left, equal), right);
+  return joinParts(left, right);
+}
+
 #endif
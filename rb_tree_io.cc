@@ -0,0 +1,158 @@
+#include "rb_tree_io.h"
+
+using namespace std;
+
+#ifdef _TC_ENABLE
+
+#include "testcase.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+
+namespace {
+struct Entry {
+  int get() const { return key; }
+
+  bool operator<(const Entry &other) const { return key < other.key; }
+  friend bool operator<(const Entry &entry, int key) { return entry.key < key; }
+  friend bool operator<(int key, const Entry &entry) { return key < entry.key; }
+
+  int key;
+  int value;
+};
+
+using EntryNode = RbNode<Entry>;
+using Tree = RbTree<Entry, int>;
+
+class TestcaseRbTreeIo : public TestcaseBase {
+public:
+  static constexpr int Count = 20000;
+
+  virtual void testRoutine() override {
+    char path[] = "/tmp/rb_tree_io.XXXXXX";
+    auto fd = mkstemp(path);
+    if (fd < 0) {
+      std::cout << "tree io failed" << endl;
+      return;
+    }
+    ::close(fd);
+
+    mt19937 rng(20240620);
+    vector<EntryNode> nodes(Count);
+    Tree tree;
+    for (int i = 0; i < Count; i++) {
+      nodes[i].key = rng() % (Count / 2);
+      nodes[i].value = i;
+      tree.insertNode(&nodes[i]);
+    }
+
+    auto saved = false;
+    {
+      FileStream stream{path, ios::binary | ios::out | ios::trunc};
+      saved = stream.isOpen() && saveTree(tree, stream);
+    }
+
+    if (saved && verifyLoad(tree, path) && verifyStream(tree, path) &&
+        verifyMapped(tree, path) && verifyDamage(path)) {
+      std::cout << "tree io verified!" << endl;
+    } else {
+      std::cout << "tree io failed" << endl;
+    }
+    unlink(path);
+  }
+
+  static bool sameInorder(Tree &a, Tree &b) {
+    vector<pair<int, int>> left, right;
+    a.forEachInorder([&](EntryNode *node) {
+      left.push_back({node->key, node->value});
+    });
+    b.forEachInorder([&](EntryNode *node) {
+      right.push_back({node->key, node->value});
+    });
+    return left == right;
+  }
+
+  bool verifyLoad(Tree &tree, const char *path) {
+    FileStream stream{path};
+    vector<EntryNode> nodes;
+    Tree loaded;
+
+    return loadTree(stream, loaded, nodes) && nodes.size() == Count &&
+           loaded.verifyTree() && sameInorder(tree, loaded);
+  }
+
+  // block by block, payloads in the order they were in the tree
+  bool verifyStream(Tree &tree, const char *path) {
+    FileStream stream{path};
+    RbTreeReader<Entry> reader{stream};
+    auto value = tree.first();
+    size_t blocks = 0;
+
+    for (auto block = reader.next(); !block.empty(); block = reader.next()) {
+      for (auto &payload : block) {
+        if (value == nullptr || value->key != payload.key ||
+            value->value != payload.value)
+          return false;
+        value = value->getNodeNext();
+      }
+      blocks++;
+    }
+    return !reader.failed() && value == nullptr &&
+           blocks == (Count + RbTreeFile::blockPayloads<Entry>() - 1) /
+                         RbTreeFile::blockPayloads<Entry>();
+  }
+
+  // blocks come straight out of the mapping
+  bool verifyMapped(Tree &tree, const char *path) {
+    MappedFileStream stream{path};
+    RbTreeReader<Entry, MappedFileStream> reader{stream};
+    auto file = stream.viewBytes(0, stream.fileSize());
+    auto inPlace = reader.isValid();
+
+    for (auto block = reader.next(); !block.empty(); block = reader.next()) {
+      auto bytes = reinterpret_cast<const char *>(block.data());
+      inPlace = inPlace && bytes >= file.data() &&
+                bytes + block.size_bytes() <= file.data() + file.size();
+    }
+
+    vector<EntryNode> nodes;
+    Tree loaded;
+    stream.advise(MappedFileStream::Random);
+    stream.willNeed(0, stream.fileSize());
+    return inPlace && !reader.failed() && loadTree(stream, loaded, nodes) &&
+           loaded.verifyTree() && sameInorder(tree, loaded);
+  }
+
+  static bool flipByte(const char *path, off_t offset) {
+    auto fd = ::open(path, O_RDWR);
+    unsigned char byte;
+    auto flipped = pread(fd, &byte, 1, offset) == 1 &&
+                   (byte ^= 0x40, pwrite(fd, &byte, 1, offset) == 1);
+    ::close(fd);
+    return flipped;
+  }
+
+  static bool loads(const char *path) {
+    FileStream stream{path};
+    vector<EntryNode> nodes;
+    Tree loaded;
+    return loadTree(stream, loaded, nodes);
+  }
+
+  // a flipped payload bit or a cut file is caught, nothing gets linked
+  bool verifyDamage(const char *path) {
+    off_t payload = sizeof(RbTreeFile::Header) +
+                    sizeof(RbTreeFile::BlockHeader) + 5 * sizeof(Entry);
+    auto caught = flipByte(path, payload) && !loads(path) &&
+                  flipByte(path, payload) && loads(path);
+
+    FileStream stream{path};
+    auto size = stream.fileSize();
+    return caught && truncate(path, size - 1) == 0 && !loads(path);
+  }
+};
+} // namespace
+INIT_CASE(TestcaseRbTreeIo)
+#endif
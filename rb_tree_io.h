@@ -0,0 +1,213 @@
+#ifndef __RB_TREE_IO_H__
+#define __RB_TREE_IO_H__
+
+#include "file_stream.h"
+#include "rb_tree.h"
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Tree files: the payloads in order, as raw bytes, cut into checksummed
+ * blocks of up to 64KB.
+ *
+ *   | header | block | block | ...
+ *   header: | magic | version | payload size | count |
+ *   block:  | count | checksum | payloads |
+ *
+ * Payloads come back sorted, so loading links the tree in O(n) through
+ * buildFromSorted(), no comparison and no rotation. Blocks are read and
+ * checked one at a time, a file is never held in memory as a whole;
+ * a MappedFileStream in place of the FileStream even saves copying them
+ * into a read buffer. Payloads must be trivially copyable, and only the
+ * payload size is checked on the way back, not its fields.
+ */
+struct RbTreeFile {
+  static constexpr char Magic[8] = {'R', 'B', 'T', 'R', 'E', 'E', 'B', 'K'};
+  static constexpr uint32_t Version = 1;
+  static constexpr size_t BlockBytes = 64 * 1024;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t payloadSize;
+    uint64_t count;
+  };
+
+  struct BlockHeader {
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t checksum;
+  };
+
+  template <class T> static constexpr size_t blockPayloads() {
+    return max<size_t>(1, BlockBytes / sizeof(T));
+  }
+
+  // FNV-1a, 64-bit
+  static uint64_t checksum(const void *data, size_t size) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+    return hash;
+  }
+};
+
+/*
+ * Streaming side of a tree file: next() hands out the payloads of one
+ * block after checking it, an empty span at the end or on the first bad
+ * block, failed() telling which. From a MappedFileStream the spans point
+ * right into the mapping, from a FileStream into a block sized buffer.
+ */
+template <class T, class Stream = FileStream> class RbTreeReader {
+  static_assert(is_trivially_copyable_v<T>, "payloads are saved as bytes");
+
+public:
+  explicit RbTreeReader(Stream &stream) : stream_{stream} {
+    RbTreeFile::Header header;
+    auto bytes = stream.fileSize();
+    valid_ = stream.loadBlock(header) == sizeof(header) &&
+             memcmp(header.magic, RbTreeFile::Magic, sizeof(header.magic)) ==
+                 0 &&
+             header.version == RbTreeFile::Version &&
+             header.payloadSize == sizeof(T) &&
+             header.count <= (bytes - sizeof(header)) / sizeof(T);
+    count_ = valid_ ? header.count : 0;
+    offset_ = sizeof(header);
+  }
+
+  // the header is readable and made for T
+  bool isValid() const { return valid_; }
+  size_t size() const { return count_; }
+  bool failed() const { return !valid_ || (done_ < count_ && ended_); }
+
+  span<const T> next() {
+    RbTreeFile::BlockHeader header;
+
+    if (!valid_ || ended_ || done_ == count_ ||
+        stream_.loadBlock(header, offset_) != sizeof(header) ||
+        header.count == 0 || header.count > RbTreeFile::blockPayloads<T>() ||
+        header.count > count_ - done_) {
+      ended_ = true;
+      return {};
+    }
+
+    auto block = blockAt(offset_ + sizeof(header), header.count);
+    if (block.size() != header.count ||
+        RbTreeFile::checksum(block.data(), block.size_bytes()) !=
+            header.checksum) {
+      ended_ = true;
+      return {};
+    }
+
+    offset_ += sizeof(header) + block.size_bytes();
+    done_ += header.count;
+    return block;
+  }
+
+private:
+  // a view if the stream has them and the payloads are aligned, or a copy
+  span<const T> blockAt(size_t offset, size_t count) {
+    if constexpr (requires { stream_.template viewBlocks<T>(0, 0); }) {
+      auto view = stream_.template viewBlocks<T>(offset, count);
+      if (view.size() == count)
+        return view;
+    }
+
+    block_.resize(count);
+    auto read = stream_.loadBlocks(block_.data(), offset, count);
+    block_.resize(static_cast<size_t>(read) / sizeof(T));
+    return block_;
+  }
+
+  Stream &stream_;
+  vector<T> block_;
+  size_t count_ = 0;
+  size_t done_ = 0;
+  size_t offset_ = 0;
+  bool valid_ = false;
+  bool ended_ = false;
+};
+
+// write the payloads of `tree` in order, false if the stream failed
+template <class Tree> bool saveTree(Tree &tree, FileStream &stream) {
+  using T = typename Tree::Payload;
+  using Value = typename Tree::Value;
+  static_assert(is_trivially_copyable_v<T>, "payloads are saved as bytes");
+
+  RbTreeFile::Header header{{}, RbTreeFile::Version, sizeof(T), 0};
+  memcpy(header.magic, RbTreeFile::Magic, sizeof(header.magic));
+  tree.forEachInorder([&](Value *) { header.count++; });
+  if (!stream.storeBlocks(&header, 1))
+    return false;
+
+  vector<T> block;
+  block.reserve(RbTreeFile::blockPayloads<T>());
+  auto flush = [&] {
+    RbTreeFile::BlockHeader blockHeader{
+        static_cast<uint32_t>(block.size()), 0,
+        RbTreeFile::checksum(block.data(), block.size() * sizeof(T))};
+    auto stored = stream.storeBlocks(&blockHeader, 1) &&
+                  stream.storeBlocks(block.data(), block.size());
+    block.clear();
+    return stored;
+  };
+
+  auto stored = tree.forEachInorder([&](Value *value) {
+    block.push_back(static_cast<const T &>(*value));
+    return block.size() < RbTreeFile::blockPayloads<T>() || flush();
+  });
+  return stored && (block.empty() || flush());
+}
+
+/*
+ * Link a saved tree into `tree`, dropping whatever it held. `make(const
+ * T &)` returns a new value holding the payload; on a bad file nothing
+ * is linked and false is returned, the values made so far are left to
+ * the caller.
+ */
+template <class Tree, class Stream, class F>
+bool loadTree(Stream &stream, Tree &tree, F &&make) {
+  using Value = typename Tree::Value;
+  RbTreeReader<typename Tree::Payload, Stream> reader{stream};
+  vector<Value *> values;
+
+  values.reserve(reader.size());
+  for (auto block = reader.next(); !block.empty(); block = reader.next()) {
+    for (auto &payload : block) {
+      values.push_back(make(payload));
+    }
+  }
+  if (reader.failed())
+    return false;
+
+  tree.buildFromSorted(values.begin(), values.end());
+  return true;
+}
+
+// the same, the values living in `nodes`, which is refilled
+template <class Tree, class Stream>
+bool loadTree(Stream &stream, Tree &tree,
+              vector<typename Tree::Value> &nodes) {
+  RbTreeReader<typename Tree::Payload, Stream> reader{stream};
+
+  nodes.clear();
+  nodes.reserve(reader.size());
+  for (auto block = reader.next(); !block.empty(); block = reader.next()) {
+    for (auto &payload : block) {
+      nodes.emplace_back(payload);
+    }
+  }
+  if (reader.failed())
+    return false;
+
+  tree.buildFromSorted(nodes.begin(), nodes.end());
+  return true;
+}
+#endif